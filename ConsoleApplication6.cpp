@@ -1,220 +1,5181 @@
-﻿#include <iostream>
-#include <fstream>
-#include <string>
-#include <vector>
-#include <sstream>
-#include <algorithm>
-#include <map>
-#include <stdexcept>
-#include <functional>
-#include <memory>
-
-using namespace std;
-class INumberReader {
-public:
-    virtual ~INumberReader() = default;
-    virtual vector<int> read(const string& filename) = 0;
-};
-class FileReader : public INumberReader {
-public:
-    vector<int> read(const string& filename) override {
-        vector<int> numbers;
-        ifstream file(filename);
-        if (!file.is_open()) {
-            throw runtime_error{ "Could not open file: " + filename };
-        }
-        string line;
-        while (getline(file, line)) {
-            stringstream ss{ line };
-            string number_str;
-            while (ss >> number_str) {
-                try {
-                    numbers.push_back(stoi(number_str));
-                }
-                catch (const invalid_argument& e) {
-                    cerr << "Warning: Invalid number in file: " << number_str << ". Skipping.\n";
-                }
-                catch (const out_of_range& e) {
-                    cerr << "Warning: Number out of range in file: " << number_str << ". Skipping.\n";
-                }
-            }
-        }
-        file.close();
-        return numbers;
-    }
-};
-class INumberFilter {
-public:
-    virtual ~INumberFilter() = default;
-    virtual bool keep(int number) const = 0;
-};
-class EvenNumberFilter : public INumberFilter {
-public:
-    bool keep(int number) const override {
-        return number % 2 == 0;
-    }
-};
-class OddNumberFilter : public INumberFilter {
-public:
-    bool keep(int number) const override {
-        return number % 2 != 0;
-    }
-};
-class GreaterThanFilter : public INumberFilter {
-private:
-    int threshold_;
-public:
-    GreaterThanFilter(int threshold) : threshold_(threshold) {}
-    bool keep(int number) const override {
-        return number > threshold_;
-    }
-};
-class FilterFactory {
-private:
-    using FilterCreator = function<unique_ptr<INumberFilter>(const string&)>;
-    map<string, FilterCreator> creators_;
-
-public:
-    FilterFactory() {
-        registerFilter("EVEN", [](const string&) { return make_unique<EvenNumberFilter>(); });
-        registerFilter("ODD", [](const string&) { return make_unique<OddNumberFilter>(); });
-        registerFilter("GT", [](const string& arg) {
-            try {
-                int threshold = stoi(arg);
-                return make_unique<GreaterThanFilter>(threshold);
-            }
-            catch (const invalid_argument& e) {
-                throw invalid_argument{ "Invalid argument for GT filter: " + arg };
-            }
-            catch (const out_of_range& e) {
-                throw out_of_range{ "Argument out of range for GT filter: " + arg };
-            }
-            });
-    }
-
-    void registerFilter(const string& filterName, FilterCreator creator) {
-        creators_[filterName] = creator;
-    }
-
-    unique_ptr<INumberFilter> createFilter(const string& filterType, const string& filterArg = "") const {
-        if (auto it = creators_.find(filterType); it != creators_.end()) {
-            return it->second(filterArg);
-        }
-        throw invalid_argument{ "Unknown filter type: " + filterType };
-    }
-};
-class INumberObserver {
-public:
-    virtual ~INumberObserver() = default;
-    virtual void on_number(int number) = 0;
-    virtual void on_finished() = 0;
-};
-
-
-class PrintObserver : public INumberObserver {
-public:
-    void on_number(int number) override {
-        cout << "Read and filtered number: " << number << endl;
-    }
-    void on_finished() override {
-        cout << "Number processing finished.\n";
-    }
-};
-
-
-class CountObserver : public INumberObserver {
-private:
-    int count_ = 0;
-public:
-    void on_number(int number) override {
-        count_++;
-    }
-    void on_finished() override {
-        cout << "Total number of filtered numbers: " << count_ << endl;
-    }
-};
-class NumberProcessor {
-private:
-    INumberReader& reader_;
-    INumberFilter& filter_;
-    vector<INumberObserver*> observers_;
-
-public:
-    NumberProcessor(INumberReader& reader, INumberFilter& filter, const vector<INumberObserver*>& observers)
-        : reader_(reader), filter_(filter), observers_(observers) {
-    }
-
-    void run(const string& filename) {
-        try {
-            vector<int> numbers = reader_.read(filename);
-            for (int number : numbers) {
-                if (filter_.keep(number)) {
-                    notifyObservers(number);
-                }
-            }
-            notifyFinished();
-        }
-        catch (const runtime_error& e) {
-            cerr << "Error during processing: " << e.what() << endl;
-        }
-    }
-
-private:
-    void notifyObservers(int number) {
-        for (INumberObserver* observer : observers_) {
-            observer->on_number(number);
-        }
-    }
-
-    void notifyFinished() {
-        for (INumberObserver* observer : observers_) {
-            observer->on_finished();
-        }
-    }
-};
-
-int main(int argc, char* argv[]) {
-    if (argc < 3) {
-        cerr << "Usage: " << argv[0] << " <filter> <file>\n";
-        cerr << "Available filters: EVEN, ODD, GT<n>\n";
-        return 1;
-    }
-
-    string filter_arg = argv[1];
-    string filename = argv[2];
-    string filter_type;
-    string filter_value;
-
-    if (filter_arg.starts_with("GT")) {
-        filter_type = "GT";
-        filter_value = filter_arg.substr(2);
-    }
-    else {
-        filter_type = filter_arg;
-    }
-
-    FilterFactory factory;
-    unique_ptr<INumberFilter> filter;
-
-    try {
-        filter = factory.createFilter(filter_type, filter_value);
-    }
-    catch (const invalid_argument& e) {
-        cerr << "Error: " << e.what() << endl;
-        return 1;
-    }
-    catch (const out_of_range& e) {
-        cerr << "Error: " << e.what() << endl;
-        return 1;
-    }
-
-    FileReader reader;
-    PrintObserver print_observer;
-    CountObserver count_observer;
-    vector<INumberObserver*> observers = { &print_observer, &count_observer };
-
-    NumberProcessor processor(reader, *filter, observers);
-    processor.run(filename);
-
-    return 0;
+﻿#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <algorithm>
+#include <map>
+#include <stdexcept>
+#include <functional>
+#include <memory>
+#include <iomanip>
+#include <cstdint>
+#include <cstring>
+#include <charconv>
+#include <string_view>
+#include <chrono>
+#include <unordered_map>
+#include <bit>
+#include <cmath>
+#include <array>
+#include <queue>
+#include <deque>
+#include <thread>
+#include <random>
+#include <filesystem>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <stop_token>
+#include <csignal>
+#include <coroutine>
+#include <span>
+#include <utility>
+#include <optional>
+
+#include "NumberPlugin.h"
+#include "ThreadPool.h"
+#include "Logger.h"
+
+#if defined(_WIN32)
+#define NOMINMAX
+#define NOGDI
+#include <windows.h>
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <linux/perf_event.h>
+#include <sys/inotify.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define HAVE_SSE2 1
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define PREFETCH(address) __builtin_prefetch(address)
+#else
+#define PREFETCH(address) ((void)0)
+#endif
+
+using namespace std;
+class MappedFile {
+public:
+    explicit MappedFile(const string& filename) {
+#if defined(__unix__) || defined(__APPLE__)
+        int fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw runtime_error{ "Could not open file: " + filename };
+        }
+        struct stat info {};
+        if (fstat(fd, &info) == 0 && info.st_size > 0) {
+            size_ = static_cast<size_t>(info.st_size);
+            void* mapping = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapping == MAP_FAILED) {
+                close(fd);
+                throw runtime_error{ "Could not map file: " + filename };
+            }
+            data_ = static_cast<const char*>(mapping);
+            madvise(mapping, size_, MADV_SEQUENTIAL);
+        }
+        close(fd);
+#else
+        ifstream file(filename, ios::binary);
+        if (!file.is_open()) {
+            throw runtime_error{ "Could not open file: " + filename };
+        }
+        contents_.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+#endif
+    }
+    ~MappedFile() {
+#if defined(__unix__) || defined(__APPLE__)
+        if (data_) {
+            munmap(const_cast<char*>(data_), size_);
+        }
+#endif
+    }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    string_view view() const {
+#if defined(__unix__) || defined(__APPLE__)
+        return { data_ ? data_ : "", size_ };
+#else
+        return contents_;
+#endif
+    }
+
+private:
+#if defined(__unix__) || defined(__APPLE__)
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+#else
+    string contents_;
+#endif
+};
+
+// Tokens are whitespace separated. Like stoi, a token is accepted when it starts
+// with a number ("12abc" reads as 12); otherwise it is reported and skipped.
+void parseNumbersInto(string_view text, vector<int>& numbers) {
+    auto is_space = [](char c) { return c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == '\v' || c == '\f'; };
+    size_t pos = 0;
+    while (pos < text.size()) {
+        while (pos < text.size() && is_space(text[pos])) {
+            ++pos;
+        }
+        size_t start = pos;
+        while (pos < text.size() && !is_space(text[pos])) {
+            ++pos;
+        }
+        if (start == pos) {
+            break;
+        }
+        const char* first = text.data() + start;
+        const char* last = text.data() + pos;
+        int value = 0;
+        auto [ptr, ec] = from_chars(first + (*first == '+' && last - first > 1 && first[1] != '-'), last, value);
+        if (ec == errc::result_out_of_range) {
+            Logger::instance().log(LogLevel::WARNING, "Warning: Number out of range in file: " + string(first, last) + ". Skipping.");
+        }
+        else if (ec != errc{}) {
+            Logger::instance().log(LogLevel::WARNING, "Warning: Invalid number in file: " + string(first, last) + ". Skipping.");
+        }
+        else {
+            numbers.push_back(value);
+        }
+    }
+}
+
+// 64 input bytes loaded once and compared against several characters, one
+// bit per byte in the resulting masks.
+class ByteBlock {
+public:
+    static constexpr size_t kSize = 64;
+
+    explicit ByteBlock(const char* bytes) {
+#if defined(HAVE_SSE2)
+        for (size_t i = 0; i < 4; ++i) {
+            lanes_[i] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bytes + 16 * i));
+        }
+#else
+        bytes_ = bytes;
+#endif
+    }
+    // Bytes in [lo, hi]; both bounds must be ASCII.
+    uint64_t in_range(char lo, char hi) const {
+#if defined(HAVE_SSE2)
+        __m128i below = _mm_set1_epi8(static_cast<char>(lo - 1));
+        __m128i above = _mm_set1_epi8(static_cast<char>(hi + 1));
+        uint64_t mask = 0;
+        for (size_t i = 0; i < 4; ++i) {
+            __m128i inside = _mm_and_si128(_mm_cmpgt_epi8(lanes_[i], below), _mm_cmplt_epi8(lanes_[i], above));
+            mask |= static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(inside))) << (16 * i);
+        }
+        return mask;
+#else
+        uint64_t mask = 0;
+        for (size_t i = 0; i < kSize; ++i) {
+            mask |= static_cast<uint64_t>(bytes_[i] >= lo && bytes_[i] <= hi) << i;
+        }
+        return mask;
+#endif
+    }
+    uint64_t equal(char c) const {
+#if defined(HAVE_SSE2)
+        __m128i needle = _mm_set1_epi8(c);
+        uint64_t mask = 0;
+        for (size_t i = 0; i < 4; ++i) {
+            mask |= static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(lanes_[i], needle)))) << (16 * i);
+        }
+        return mask;
+#else
+        uint64_t mask = 0;
+        for (size_t i = 0; i < kSize; ++i) {
+            mask |= static_cast<uint64_t>(bytes_[i] == c) << i;
+        }
+        return mask;
+#endif
+    }
+
+private:
+#if defined(HAVE_SSE2)
+    __m128i lanes_[4];
+#else
+    const char* bytes_;
+#endif
+};
+
+// Bit i of the result is the parity of bits 0..i: applied to the quote mask
+// it marks every byte from an opening quote up to its closing quote.
+inline uint64_t prefixXor(uint64_t bits) {
+    for (int shift = 1; shift < 64; shift <<= 1) {
+        bits ^= bits << shift;
+    }
+    return bits;
+}
+
+// Two-stage parse of whitespace-separated numbers with the same results and
+// warnings as parseNumbersInto. Stage 1 classifies each 64-byte block into
+// masks and records where every token starts and ends, plus the positions of
+// bytes that cannot appear in a plain [+-]digits token. Stage 2 converts the
+// tokens with a branch-light digit loop and hands irregular ones (bad bytes,
+// misplaced signs, more than ten digits, overflow) to parseNumbersInto.
+class StructuralParser {
+private:
+    vector<uint32_t> starts_;
+    vector<uint32_t> ends_;
+    vector<uint32_t> irregular_;
+    size_t tokens_ = 0;
+    size_t irregular_count_ = 0;
+
+    // Writes four positions per step without checking for the last one, so
+    // the buffers keep a few entries of slack; countr_zero(0) is 64.
+    static uint32_t* appendPositions(uint32_t* out, uint64_t bits, uint32_t offset) {
+        uint32_t* end = out + popcount(bits);
+        while (out < end) {
+            for (int i = 0; i < 4; ++i) {
+                out[i] = offset + static_cast<uint32_t>(countr_zero(bits));
+                bits &= bits - 1;
+            }
+            out += 4;
+        }
+        return end;
+    }
+
+    // Value of eight ASCII digits packed little-endian into a word; zero bytes
+    // shifted in at the low (leading) end count as leading zeros.
+    static uint64_t eightDigits(uint64_t word) {
+        word = (word & 0x0F0F0F0F0F0F0F0Full) * 2561 >> 8;
+        word = (word & 0x00FF00FF00FF00FFull) * 6553601 >> 16;
+        return (word & 0x0000FFFF0000FFFFull) * 42949672960001ull >> 32;
+    }
+
+    static uint64_t load8(const char* bytes) {
+        uint64_t word;
+        memcpy(&word, bytes, sizeof(word));
+        return word;
+    }
+
+    // 1 to 10 digits; reads eight bytes from `digits` and from its last eight.
+    static uint64_t digitsValue(const char* digits, size_t length) {
+        if (length <= 8) {
+            return eightDigits(load8(digits) << (8 * (8 - length)));
+        }
+        return eightDigits(load8(digits) << (8 * (16 - length))) * 100000000 + eightDigits(load8(digits + length - 8));
+    }
+
+    void index(string_view text) {
+        size_t capacity = text.size() + ByteBlock::kSize + 4;
+        if (starts_.size() < capacity) {
+            starts_.resize(capacity);
+            ends_.resize(capacity);
+            irregular_.resize(capacity);
+        }
+        uint32_t* starts_out = starts_.data();
+        uint32_t* ends_out = ends_.data();
+        uint32_t* irregular_out = irregular_.data();
+        char tail[ByteBlock::kSize];
+        uint64_t previous_token = 0;
+        for (size_t offset = 0; offset < text.size(); offset += ByteBlock::kSize) {
+            const char* bytes = text.data() + offset;
+            size_t valid = min(ByteBlock::kSize, text.size() - offset);
+            if (valid < ByteBlock::kSize) {
+                memset(tail, ' ', sizeof(tail));
+                memcpy(tail, bytes, valid);
+                bytes = tail;
+            }
+            ByteBlock block(bytes);
+            uint64_t space = block.equal(' ') | block.in_range('\t', '\r');
+            uint64_t token = ~space;
+            uint64_t shifted = (token << 1) | previous_token;
+            uint64_t starts = token & ~shifted;
+            uint64_t ends = ~token & shifted;
+            uint64_t sign = block.equal('+') | block.equal('-');
+            uint64_t irregular = token & ~(block.in_range('0', '9') | (sign & starts));
+            previous_token = token >> 63;
+            uint32_t base = static_cast<uint32_t>(offset);
+            starts_out = appendPositions(starts_out, starts, base);
+            ends_out = appendPositions(ends_out, ends, base);
+            irregular_out = appendPositions(irregular_out, irregular, base);
+        }
+        tokens_ = static_cast<size_t>(starts_out - starts_.data());
+        if (ends_out - ends_.data() < starts_out - starts_.data()) {
+            *ends_out = static_cast<uint32_t>(text.size());
+        }
+        irregular_count_ = static_cast<size_t>(irregular_out - irregular_.data());
+    }
+
+public:
+    void parse(string_view text, vector<int>& numbers) {
+        if (text.size() > UINT32_MAX - ByteBlock::kSize) {
+            parseNumbersInto(text, numbers);
+            return;
+        }
+        index(text);
+        numbers.reserve(numbers.size() + tokens_);
+        size_t next_irregular = 0;
+        for (size_t i = 0; i < tokens_; ++i) {
+            const char* first = text.data() + starts_[i];
+            const char* last = text.data() + ends_[i];
+            while (next_irregular < irregular_count_ && irregular_[next_irregular] < starts_[i]) {
+                ++next_irregular;
+            }
+            bool negative = *first == '-';
+            const char* digits = first + (negative || *first == '+');
+            size_t length = static_cast<size_t>(last - digits);
+            bool regular = (next_irregular == irregular_count_ || irregular_[next_irregular] >= ends_[i]) && length - 1 < 10;
+            uint64_t value = 0;
+            if (regular && endian::native == endian::little && text.data() + text.size() - digits >= 8) {
+                value = digitsValue(digits, length);
+            }
+            else {
+                for (size_t d = 0; regular && d < length; ++d) {
+                    value = value * 10 + static_cast<uint64_t>(digits[d] - '0');
+                }
+            }
+            if (regular && value <= 2147483647ull + negative) {
+                numbers.push_back(static_cast<int>(negative ? 0 - value : value));
+            }
+            else {
+                parseNumbersInto(string_view(first, static_cast<size_t>(last - first)), numbers);
+            }
+        }
+    }
+};
+
+// Unparsed input that ends on a token boundary (whole ints for binary
+// input), with the reader position just past it when the reader can resume.
+struct InputChunk {
+    string_view bytes;
+    bool binary;
+    optional<uint64_t> end;
+};
+
+void parseInputChunk(const InputChunk& chunk, StructuralParser& parser, vector<int>& numbers) {
+    if (chunk.binary) {
+        size_t first = numbers.size();
+        numbers.resize(first + chunk.bytes.size() / sizeof(int));
+        memcpy(numbers.data() + first, chunk.bytes.data(), chunk.bytes.size());
+    }
+    else {
+        parser.parse(chunk.bytes, numbers);
+    }
+}
+
+vector<int> parseNumbers(string_view text) {
+    vector<int> numbers;
+    parseNumbersInto(text, numbers);
+    return numbers;
+}
+// Minimal lazy generator: the coroutine body runs only as the consumer
+// advances, and destroying the generator abandons the rest of the work.
+template <typename T>
+class Generator {
+public:
+    struct promise_type {
+        const T* current = nullptr;
+        exception_ptr error;
+        Generator get_return_object() {
+            return Generator{ coroutine_handle<promise_type>::from_promise(*this) };
+        }
+        suspend_always initial_suspend() noexcept { return {}; }
+        suspend_always final_suspend() noexcept { return {}; }
+        suspend_always yield_value(const T& value) noexcept {
+            current = addressof(value);
+            return {};
+        }
+        void return_void() noexcept {}
+        void unhandled_exception() {
+            error = current_exception();
+        }
+    };
+
+    class iterator {
+    private:
+        coroutine_handle<promise_type> coroutine_;
+    public:
+        explicit iterator(coroutine_handle<promise_type> coroutine) : coroutine_(coroutine) {}
+        const T& operator*() const {
+            return *coroutine_.promise().current;
+        }
+        iterator& operator++() {
+            advance(coroutine_);
+            return *this;
+        }
+        bool operator==(default_sentinel_t) const {
+            return !coroutine_ || coroutine_.done();
+        }
+    };
+
+    Generator(Generator&& other) noexcept : coroutine_(exchange(other.coroutine_, {})) {}
+    Generator& operator=(Generator&& other) noexcept {
+        if (this != &other) {
+            if (coroutine_) {
+                coroutine_.destroy();
+            }
+            coroutine_ = exchange(other.coroutine_, {});
+        }
+        return *this;
+    }
+    ~Generator() {
+        if (coroutine_) {
+            coroutine_.destroy();
+        }
+    }
+
+    iterator begin() {
+        advance(coroutine_);
+        return iterator{ coroutine_ };
+    }
+    default_sentinel_t end() {
+        return {};
+    }
+
+private:
+    coroutine_handle<promise_type> coroutine_;
+
+    explicit Generator(coroutine_handle<promise_type> coroutine) : coroutine_(coroutine) {}
+    static void advance(coroutine_handle<promise_type> coroutine) {
+        if (coroutine && !coroutine.done()) {
+            coroutine.resume();
+            if (coroutine.promise().error) {
+                rethrow_exception(coroutine.promise().error);
+            }
+        }
+    }
+};
+
+using NumberBatches = Generator<span<const int>>;
+
+enum class HugePages {
+    OFF,
+    TRANSPARENT,
+    EXPLICIT
+};
+
+// Chosen once at startup, before any large buffer is allocated.
+HugePages huge_page_mode = HugePages::OFF;
+
+// Allocations of at least one huge page are mapped directly, rounded up to
+// whole 2 MiB pages and 2 MiB aligned. TRANSPARENT asks the kernel to back them
+// with transparent huge pages; EXPLICIT first tries the reserved hugetlbfs
+// pool and falls back to TRANSPARENT when it is empty or not configured.
+// Smaller allocations, and every allocation on platforms without mmap, come
+// from operator new.
+inline constexpr size_t kHugePageSize = 2 << 20;
+
+inline void* allocateLarge(size_t bytes) {
+#if defined(__unix__) || defined(__APPLE__)
+    if (bytes >= kHugePageSize) {
+        size_t length = (bytes + kHugePageSize - 1) & ~(kHugePageSize - 1);
+#if defined(MAP_HUGETLB)
+        if (huge_page_mode == HugePages::EXPLICIT) {
+            void* pages = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (pages != MAP_FAILED) {
+                return pages;
+            }
+        }
+#endif
+        void* mapping = mmap(nullptr, length + kHugePageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mapping == MAP_FAILED) {
+            throw bad_alloc{};
+        }
+        uintptr_t start = reinterpret_cast<uintptr_t>(mapping);
+        uintptr_t aligned = (start + kHugePageSize - 1) & ~(kHugePageSize - 1);
+        if (aligned > start) {
+            munmap(mapping, aligned - start);
+        }
+        munmap(reinterpret_cast<void*>(aligned + length), start + kHugePageSize - aligned);
+#if defined(MADV_HUGEPAGE)
+        if (huge_page_mode != HugePages::OFF) {
+            madvise(reinterpret_cast<void*>(aligned), length, MADV_HUGEPAGE);
+        }
+#endif
+        return reinterpret_cast<void*>(aligned);
+    }
+#endif
+    return ::operator new(bytes);
+}
+
+inline void releaseLarge(void* pointer, size_t bytes) {
+#if defined(__unix__) || defined(__APPLE__)
+    if (bytes >= kHugePageSize) {
+        munmap(pointer, (bytes + kHugePageSize - 1) & ~(kHugePageSize - 1));
+        return;
+    }
+#endif
+    ::operator delete(pointer);
+}
+
+template <typename T>
+struct HugePageAllocator {
+    using value_type = T;
+
+    HugePageAllocator() = default;
+    template <typename U>
+    HugePageAllocator(const HugePageAllocator<U>&) {
+    }
+    T* allocate(size_t count) {
+        return static_cast<T*>(allocateLarge(count * sizeof(T)));
+    }
+    void deallocate(T* pointer, size_t count) {
+        releaseLarge(pointer, count * sizeof(T));
+    }
+    template <typename U>
+    bool operator==(const HugePageAllocator<U>&) const {
+        return true;
+    }
+};
+
+// Whole-input and other potentially multi-GB number buffers.
+using NumberBuffer = vector<int, HugePageAllocator<int>>;
+
+template <typename T>
+void writeValue(ostream& out, const T& value) {
+    out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+T readValue(istream& in) {
+    T value{};
+    if (!in.read(reinterpret_cast<char*>(&value), sizeof(T))) {
+        throw runtime_error{ "Checkpoint is truncated" };
+    }
+    return value;
+}
+
+template <typename T, typename Allocator>
+void writeVector(ostream& out, const vector<T, Allocator>& values) {
+    writeValue<uint64_t>(out, values.size());
+    out.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+}
+
+template <typename T>
+vector<T> readVector(istream& in) {
+    vector<T> values(readValue<uint64_t>(in));
+    if (!in.read(reinterpret_cast<char*>(values.data()), values.size() * sizeof(T))) {
+        throw runtime_error{ "Checkpoint is truncated" };
+    }
+    return values;
+}
+
+// Binary number files: this header followed by native-endian 32-bit ints.
+inline constexpr char kBinaryNumbersMagic[8] = { 'N', 'U', 'M', 'B', 'I', 'N', '0', '1' };
+inline constexpr unsigned char kZstdMagic[4] = { 0x28, 0xB5, 0x2F, 0xFD };
+
+// The few libzstd streaming entry points we use, resolved at runtime so the
+// build needs no zstd headers; compression is unavailable, with an error,
+// where the library is missing.
+class Zstd {
+public:
+    struct InBuffer {
+        const void* src;
+        size_t size;
+        size_t pos;
+    };
+    struct OutBuffer {
+        void* dst;
+        size_t size;
+        size_t pos;
+    };
+
+    void* (*createCStream)() = nullptr;
+    size_t (*freeCStream)(void*) = nullptr;
+    size_t (*initCStream)(void*, int) = nullptr;
+    size_t (*compressStream)(void*, OutBuffer*, InBuffer*) = nullptr;
+    size_t (*endStream)(void*, OutBuffer*) = nullptr;
+    size_t (*cStreamOutSize)() = nullptr;
+    void* (*createDStream)() = nullptr;
+    size_t (*freeDStream)(void*) = nullptr;
+    size_t (*initDStream)(void*) = nullptr;
+    size_t (*decompressStream)(void*, OutBuffer*, InBuffer*) = nullptr;
+    unsigned (*isError)(size_t) = nullptr;
+    const char* (*getErrorName)(size_t) = nullptr;
+
+    static const Zstd& get() {
+        static const Zstd library = load();
+        if (!library.isError) {
+            throw runtime_error{ "zstd support requires libzstd, which could not be loaded" };
+        }
+        return library;
+    }
+
+    size_t check(size_t result) const {
+        if (isError(result)) {
+            throw runtime_error{ string("zstd error: ") + getErrorName(result) };
+        }
+        return result;
+    }
+
+private:
+    static Zstd load() {
+        Zstd library;
+#if defined(_WIN32)
+        HMODULE handle = LoadLibraryA("libzstd.dll");
+        auto symbol = [&](const char* name) { return handle ? reinterpret_cast<void*>(GetProcAddress(handle, name)) : nullptr; };
+#else
+        void* handle = dlopen("libzstd.so.1", RTLD_NOW | RTLD_LOCAL);
+        if (!handle) {
+            handle = dlopen("libzstd.so", RTLD_NOW | RTLD_LOCAL);
+        }
+        auto symbol = [&](const char* name) { return handle ? dlsym(handle, name) : nullptr; };
+#endif
+        bool complete = true;
+        auto resolve = [&](auto& function, const char* name) {
+            function = reinterpret_cast<remove_reference_t<decltype(function)>>(symbol(name));
+            complete = complete && function;
+        };
+        resolve(library.createCStream, "ZSTD_createCStream");
+        resolve(library.freeCStream, "ZSTD_freeCStream");
+        resolve(library.initCStream, "ZSTD_initCStream");
+        resolve(library.compressStream, "ZSTD_compressStream");
+        resolve(library.endStream, "ZSTD_endStream");
+        resolve(library.cStreamOutSize, "ZSTD_CStreamOutSize");
+        resolve(library.createDStream, "ZSTD_createDStream");
+        resolve(library.freeDStream, "ZSTD_freeDStream");
+        resolve(library.initDStream, "ZSTD_initDStream");
+        resolve(library.decompressStream, "ZSTD_decompressStream");
+        resolve(library.getErrorName, "ZSTD_getErrorName");
+        resolve(library.isError, "ZSTD_isError");
+        if (!complete) {
+            library.isError = nullptr;
+        }
+        return library;
+    }
+};
+
+optional<uint64_t> regularFileSize(const string& filename) {
+    error_code error;
+    if (!filesystem::is_regular_file(filename, error)) {
+        return nullopt;
+    }
+    uintmax_t size = filesystem::file_size(filename, error);
+    if (error) {
+        return nullopt;
+    }
+    return static_cast<uint64_t>(size);
+}
+
+class INumberReader {
+public:
+    virtual ~INumberReader() = default;
+    virtual NumberBuffer read(const string& filename) = 0;
+    // Streams the numbers found from byte offset `start` on. Readers that cannot
+    // resume mid-file accept only start == 0 and report no position().
+    virtual NumberBatches stream(const string& filename, uint64_t start = 0) {
+        if (start != 0) {
+            throw runtime_error{ "This reader cannot resume from a byte offset" };
+        }
+        NumberBuffer numbers = read(filename);
+        for (size_t begin = 0; begin < numbers.size(); begin += kStreamBatchSize) {
+            co_yield span<const int>(numbers.data() + begin, min(kStreamBatchSize, numbers.size() - begin));
+        }
+    }
+    // Byte offset just past the input behind every batch yielded so far.
+    virtual optional<uint64_t> position() const {
+        return nullopt;
+    }
+    // The position() the input ends at, when that is known before reading;
+    // a growing or compressed input has none.
+    virtual optional<uint64_t> input_size(const string& /*filename*/) const {
+        return nullopt;
+    }
+    // Readers of raw text or binary files can also hand out their input
+    // unparsed, so that callers may parse it on other threads.
+    virtual bool has_chunks() const {
+        return false;
+    }
+    virtual Generator<InputChunk> chunks(const string& /*filename*/, uint64_t /*start*/ = 0) {
+        throw runtime_error{ "This reader cannot provide unparsed input" };
+    }
+
+protected:
+    static constexpr size_t kStreamBatchSize = 1 << 16;
+};
+class FileReader : public INumberReader {
+public:
+    NumberBuffer read(const string& filename) override {
+        NumberBuffer numbers;
+        for (span<const int> batch : stream(filename, 0)) {
+            numbers.insert(numbers.end(), batch.begin(), batch.end());
+        }
+        return numbers;
+    }
+
+    NumberBatches stream(const string& filename, uint64_t start = 0) override {
+        vector<int> numbers;
+        for (const InputChunk& chunk : chunks(filename, start)) {
+            numbers.clear();
+            parseInputChunk(chunk, parser_, numbers);
+            if (!numbers.empty()) {
+                co_yield span<const int>(numbers);
+            }
+        }
+    }
+
+    bool has_chunks() const override {
+        return true;
+    }
+
+    // Reads the file one chunk at a time; a token cut by the chunk boundary is
+    // carried over into the next chunk. Binary number files and zstd-compressed
+    // files (of either kind) are recognised by their magic bytes; compressed
+    // input cannot be resumed from an offset.
+    Generator<InputChunk> chunks(const string& filename, uint64_t start = 0) override {
+        ifstream file(filename, ios::binary);
+        if (!file.is_open()) {
+            throw runtime_error{ "Could not open file: " + filename };
+        }
+        char magic[sizeof(kBinaryNumbersMagic)] = {};
+        file.read(magic, sizeof(magic));
+        size_t magic_size = static_cast<size_t>(file.gcount());
+        file.clear();
+        bool compressed = equal(begin(kZstdMagic), end(kZstdMagic), reinterpret_cast<unsigned char*>(magic));
+        bool binary = equal(begin(magic), end(magic), begin(kBinaryNumbersMagic));
+        if (compressed && start != 0) {
+            throw runtime_error{ "Compressed input cannot be resumed from an offset: " + filename };
+        }
+        position_ = binary ? max<uint64_t>(start, sizeof(magic)) : start;
+        resumable_ = !compressed;
+        // The bytes already peeked are replayed rather than re-read, so pipes,
+        // which cannot seek, work when starting from the beginning.
+        string peeked;
+        if (start == 0) {
+            peeked.assign(magic, binary ? 0 : magic_size);
+        }
+        else {
+            file.seekg(static_cast<streamoff>(position_));
+        }
+        Source source(file, compressed, peeked);
+        vector<char> chunk(kChunkBytes);
+        string pending;
+        for (bool first = compressed;; first = false) {
+            size_t got = source.read(chunk.data(), chunk.size());
+            bool at_end = got < chunk.size();
+            pending.append(chunk.data(), got);
+            if (first && pending.starts_with(string_view(kBinaryNumbersMagic, sizeof(kBinaryNumbersMagic)))) {
+                binary = true;
+                pending.erase(0, sizeof(kBinaryNumbersMagic));
+            }
+            size_t cut;
+            if (binary) {
+                cut = pending.size() - pending.size() % sizeof(int);
+                if (at_end && cut != pending.size()) {
+                    throw runtime_error{ "Binary input ends with a partial number: " + filename };
+                }
+            }
+            else {
+                cut = at_end ? pending.size() : pending.find_last_of(" \n\r\t\v\f") + 1;
+            }
+            position_ += cut;
+            if (cut > 0) {
+                co_yield InputChunk{ string_view(pending).substr(0, cut), binary, position() };
+            }
+            pending.erase(0, cut);
+            if (at_end) {
+                co_return;
+            }
+        }
+    }
+
+    optional<uint64_t> position() const override {
+        if (!resumable_) {
+            return nullopt;
+        }
+        return position_;
+    }
+
+    optional<uint64_t> input_size(const string& filename) const override {
+        ifstream file(filename, ios::binary);
+        unsigned char magic[sizeof(kZstdMagic)] = {};
+        file.read(reinterpret_cast<char*>(magic), sizeof(magic));
+        if (equal(begin(kZstdMagic), end(kZstdMagic), magic)) {
+            return nullopt;
+        }
+        return regularFileSize(filename);
+    }
+
+private:
+    static constexpr size_t kChunkBytes = 1 << 20;
+    StructuralParser parser_;
+    uint64_t position_ = 0;
+    bool resumable_ = true;
+
+    // Raw or zstd-decompressed bytes of the file; read() fills the whole
+    // buffer unless the input ends.
+    class Source {
+    private:
+        ifstream& file_;
+        void* stream_ = nullptr;
+        vector<char> compressed_;
+        Zstd::InBuffer input_{ nullptr, 0, 0 };
+        bool frame_done_ = true;
+        bool at_eof_ = false;
+        string prefix_;
+
+    public:
+        // `prefix` holds bytes already taken from the start of the file.
+        Source(ifstream& file, bool compressed, const string& prefix) : file_(file) {
+            if (compressed) {
+                const Zstd& zstd = Zstd::get();
+                stream_ = zstd.createDStream();
+                zstd.check(zstd.initDStream(stream_));
+                compressed_.resize(kChunkBytes);
+                copy(prefix.begin(), prefix.end(), compressed_.begin());
+                input_ = Zstd::InBuffer{ compressed_.data(), prefix.size(), 0 };
+            }
+            else {
+                prefix_ = prefix;
+            }
+        }
+        Source(const Source&) = delete;
+        Source& operator=(const Source&) = delete;
+        ~Source() {
+            if (stream_) {
+                Zstd::get().freeDStream(stream_);
+            }
+        }
+        size_t read(char* buffer, size_t size) {
+            if (!stream_) {
+                size_t replayed = min(size, prefix_.size());
+                memcpy(buffer, prefix_.data(), replayed);
+                prefix_.erase(0, replayed);
+                file_.read(buffer + replayed, size - replayed);
+                return replayed + static_cast<size_t>(file_.gcount());
+            }
+            const Zstd& zstd = Zstd::get();
+            Zstd::OutBuffer output{ buffer, size, 0 };
+            while (output.pos < output.size) {
+                if (input_.pos == input_.size && !at_eof_) {
+                    file_.read(compressed_.data(), compressed_.size());
+                    input_ = Zstd::InBuffer{ compressed_.data(), static_cast<size_t>(file_.gcount()), 0 };
+                    at_eof_ = input_.size == 0;
+                }
+                size_t produced = output.pos;
+                size_t consumed = input_.pos;
+                size_t hint = zstd.check(zstd.decompressStream(stream_, &output, &input_));
+                if (output.pos != produced || input_.pos != consumed) {
+                    frame_done_ = hint == 0;
+                }
+                else if (at_eof_) {
+                    if (!frame_done_) {
+                        throw runtime_error{ "Compressed input is truncated" };
+                    }
+                    break;
+                }
+            }
+            return output.pos;
+        }
+    };
+};
+// Keeps reading a file that producers append to. After reaching the current
+// end it waits for growth (inotify on Linux, polling elsewhere) and parses only
+// the new bytes; a token without trailing whitespace at EOF may still be
+// growing, so it is held back until more data arrives. When the reader stops
+// such a trailing partial token is dropped, and the reported position ends
+// before it so that a resumed run reads it whole.
+// While idle it yields empty batches every poll interval so the consumer can
+// take snapshots and check for cancellation.
+class FollowingFileReader : public INumberReader {
+private:
+    static constexpr size_t kChunkBytes = 1 << 20;
+    StructuralParser parser_;
+    function<bool()> should_stop_;
+    chrono::milliseconds poll_interval_;
+
+    void waitForGrowth(int watch_fd) const {
+#if defined(__linux__)
+        if (watch_fd >= 0) {
+            pollfd descriptor{ watch_fd, POLLIN, 0 };
+            if (poll(&descriptor, 1, static_cast<int>(poll_interval_.count())) > 0) {
+                char events[4096];
+                while (::read(watch_fd, events, sizeof(events)) > 0) {
+                }
+            }
+            return;
+        }
+#endif
+        (void)watch_fd;
+        this_thread::sleep_for(poll_interval_);
+    }
+
+public:
+    FollowingFileReader(function<bool()> should_stop, chrono::milliseconds poll_interval = chrono::milliseconds(500))
+        : should_stop_(move(should_stop)), poll_interval_(poll_interval) {
+    }
+
+    NumberBuffer read(const string& filename) override {
+        NumberBuffer numbers;
+        for (span<const int> batch : stream(filename, 0)) {
+            numbers.insert(numbers.end(), batch.begin(), batch.end());
+        }
+        return numbers;
+    }
+
+    NumberBatches stream(const string& filename, uint64_t start = 0) override {
+        ifstream file(filename, ios::binary);
+        if (!file.is_open()) {
+            throw runtime_error{ "Could not open file: " + filename };
+        }
+        file.seekg(static_cast<streamoff>(start));
+        position_ = start;
+        int watch_fd = -1;
+#if defined(__linux__)
+        watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (watch_fd >= 0 && inotify_add_watch(watch_fd, filename.c_str(), IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE) < 0) {
+            close(watch_fd);
+            watch_fd = -1;
+        }
+        unique_ptr<int, void (*)(int*)> watch_guard(&watch_fd, [](int* fd) {
+            if (*fd >= 0) {
+                close(*fd);
+            }
+            });
+#endif
+        vector<char> chunk(kChunkBytes);
+        string pending;
+        vector<int> numbers;
+        uint64_t offset = start;
+        for (;;) {
+            bool stopping = should_stop_();
+            file.clear();
+            file.read(chunk.data(), chunk.size());
+            size_t got = static_cast<size_t>(file.gcount());
+            offset += got;
+            pending.append(chunk.data(), got);
+            // An unterminated tail may be half written, even when stopping; it
+            // stays unparsed so position_ (and a checkpoint) ends before it.
+            size_t cut = pending.find_last_of(" \n\r\t\v\f") + 1;
+            numbers.clear();
+            parser_.parse(string_view(pending).substr(0, cut), numbers);
+            pending.erase(0, cut);
+            position_ = offset - pending.size();
+            co_yield span<const int>(numbers);
+            if (stopping) {
+                co_return;
+            }
+            if (got < chunk.size()) {
+                error_code error;
+                uint64_t size = filesystem::file_size(filename, error);
+                if (!error && size < offset) {
+                    Logger::instance().log(LogLevel::WARNING, "Warning: " + filename + " was truncated; reading from the beginning.");
+                    file.clear();
+                    file.seekg(0);
+                    offset = 0;
+                    pending.clear();
+                    position_ = 0;
+                    continue;
+                }
+                waitForGrowth(watch_fd);
+            }
+        }
+    }
+
+    optional<uint64_t> position() const override {
+        return position_;
+    }
+
+private:
+    uint64_t position_ = 0;
+};
+
+// Reads one column of delimited text such as CSV or TSV. Each 64-byte block is
+// classified at once into masks of quotes, delimiters and newlines; the prefix
+// XOR of the quote mask (carried across blocks) hides separators inside quoted
+// fields, and only the selected field of each record is parsed. The column is
+// a 1-based index or, when the first line is a header, a column name.
+class DelimitedReader : public INumberReader {
+private:
+    static constexpr size_t kChunkBytes = 1 << 20;
+    char delimiter_;
+    string column_;
+    bool header_;
+    uint64_t position_ = 0;
+
+    static string_view trim(string_view field) {
+        while (!field.empty() && (field.front() == ' ' || field.front() == '\t')) {
+            field.remove_prefix(1);
+        }
+        while (!field.empty() && (field.back() == ' ' || field.back() == '\t' || field.back() == '\r')) {
+            field.remove_suffix(1);
+        }
+        return field;
+    }
+
+    // Strips the surrounding quotes of a quoted field and turns each doubled
+    // quote inside it back into one.
+    static string unquote(string_view field) {
+        field = trim(field);
+        if (field.size() < 2 || field.front() != '"' || field.back() != '"') {
+            return string(field);
+        }
+        string text;
+        field = field.substr(1, field.size() - 2);
+        for (size_t i = 0; i < field.size(); ++i) {
+            text += field[i];
+            i += field[i] == '"' && i + 1 < field.size() && field[i + 1] == '"';
+        }
+        return string(trim(text));
+    }
+
+    // Each selected field holds exactly one number. An empty field is a missing
+    // value and is skipped silently; anything else is reported and skipped.
+    static void parseField(string_view field, vector<int>& numbers) {
+        string text = unquote(field);
+        if (text.empty()) {
+            return;
+        }
+        const char* first = text.data();
+        const char* last = first + text.size();
+        int value = 0;
+        auto [ptr, ec] = from_chars(first + (*first == '+' && last - first > 1 && first[1] != '-'), last, value);
+        if (ec == errc::result_out_of_range) {
+            Logger::instance().log(LogLevel::WARNING, "Warning: Number out of range in file: " + text + ". Skipping.");
+        }
+        else if (ec != errc{} || ptr != last) {
+            Logger::instance().log(LogLevel::WARNING, "Warning: Invalid number in file: " + text + ". Skipping.");
+        }
+        else {
+            numbers.push_back(value);
+        }
+    }
+
+    // Returns the 0-based column and the offset of the first data record.
+    pair<size_t, uint64_t> resolveColumn(const string& filename) const {
+        bool by_name = column_.empty() || !all_of(column_.begin(), column_.end(), [](char c) { return isdigit(static_cast<unsigned char>(c)); });
+        size_t column = by_name ? 0 : stoul(column_);
+        if (!by_name && column == 0) {
+            throw runtime_error{ "Column indexes start at 1" };
+        }
+        if (!by_name && !header_) {
+            return { column - 1, 0 };
+        }
+        ifstream file(filename, ios::binary);
+        if (!file.is_open()) {
+            throw runtime_error{ "Could not open file: " + filename };
+        }
+        vector<string> names(1);
+        bool quoted = false;
+        uint64_t length = 0;
+        for (char c; file.get(c);) {
+            ++length;
+            if (c == '"') {
+                quoted = !quoted;
+            }
+            if (c == '\n' && !quoted) {
+                break;
+            }
+            if (c == delimiter_ && !quoted) {
+                names.emplace_back();
+            }
+            else {
+                names.back() += c;
+            }
+        }
+        if (!by_name) {
+            return { column - 1, length };
+        }
+        for (size_t i = 0; i < names.size(); ++i) {
+            if (unquote(names[i]) == column_) {
+                return { i, length };
+            }
+        }
+        throw runtime_error{ "Column not found in header: " + column_ };
+    }
+
+    // Parses the selected field of every complete record in `text` and returns
+    // the length of those records; with `at_end` the text ends the last record.
+    size_t scan(string_view text, bool at_end, size_t column, vector<int>& numbers) const {
+        char tail[ByteBlock::kSize];
+        uint64_t in_quotes = 0;
+        size_t field = 0;
+        size_t field_begin = 0;
+        size_t records_end = 0;
+        optional<string_view> selected;
+        for (size_t offset = 0; offset < text.size(); offset += ByteBlock::kSize) {
+            const char* bytes = text.data() + offset;
+            size_t valid = min(ByteBlock::kSize, text.size() - offset);
+            if (valid < ByteBlock::kSize) {
+                memset(tail, 0, sizeof(tail));
+                memcpy(tail, bytes, valid);
+                bytes = tail;
+            }
+            ByteBlock block(bytes);
+            uint64_t quoted = prefixXor(block.equal('"')) ^ in_quotes;
+            in_quotes = static_cast<uint64_t>(static_cast<int64_t>(quoted) >> 63);
+            uint64_t newlines = block.equal('\n') & ~quoted;
+            uint64_t separators = (block.equal(delimiter_) | newlines) & ~quoted;
+            while (separators) {
+                size_t pos = offset + countr_zero(separators);
+                if (field == column) {
+                    selected = text.substr(field_begin, pos - field_begin);
+                }
+                if (newlines & (separators & (0 - separators))) {
+                    if (selected) {
+                        parseField(*selected, numbers);
+                        selected.reset();
+                    }
+                    field = 0;
+                    records_end = pos + 1;
+                }
+                else {
+                    ++field;
+                }
+                field_begin = pos + 1;
+                separators &= separators - 1;
+            }
+        }
+        if (at_end && records_end < text.size()) {
+            if (field == column) {
+                selected = text.substr(field_begin);
+            }
+            if (selected) {
+                parseField(*selected, numbers);
+            }
+            records_end = text.size();
+        }
+        return records_end;
+    }
+
+public:
+    DelimitedReader(char delimiter, const string& column, bool header)
+        : delimiter_(delimiter), column_(column), header_(header) {
+    }
+
+    NumberBuffer read(const string& filename) override {
+        NumberBuffer numbers;
+        for (span<const int> batch : stream(filename, 0)) {
+            numbers.insert(numbers.end(), batch.begin(), batch.end());
+        }
+        return numbers;
+    }
+
+    NumberBatches stream(const string& filename, uint64_t start = 0) override {
+        auto [column, data_start] = resolveColumn(filename);
+        ifstream file(filename, ios::binary);
+        if (!file.is_open()) {
+            throw runtime_error{ "Could not open file: " + filename };
+        }
+        position_ = max(start, data_start);
+        file.seekg(static_cast<streamoff>(position_));
+        vector<char> chunk(kChunkBytes);
+        string pending;
+        vector<int> numbers;
+        for (;;) {
+            file.read(chunk.data(), chunk.size());
+            size_t got = static_cast<size_t>(file.gcount());
+            bool at_end = got < chunk.size();
+            pending.append(chunk.data(), got);
+            numbers.clear();
+            size_t cut = scan(pending, at_end, column, numbers);
+            pending.erase(0, cut);
+            position_ += cut;
+            if (!numbers.empty()) {
+                co_yield span<const int>(numbers);
+            }
+            if (at_end) {
+                co_return;
+            }
+        }
+    }
+
+    optional<uint64_t> position() const override {
+        return position_;
+    }
+
+    optional<uint64_t> input_size(const string& filename) const override {
+        return regularFileSize(filename);
+    }
+};
+
+using Datasets = map<string, NumberBuffer>;
+// Serves already parsed datasets by name instead of reading files.
+class DatasetReader : public INumberReader {
+private:
+    const Datasets& datasets_;
+
+    const NumberBuffer& find(const string& name) const {
+        auto it = datasets_.find(name);
+        if (it == datasets_.end()) {
+            throw runtime_error{ "Unknown dataset: " + name };
+        }
+        return it->second;
+    }
+
+public:
+    explicit DatasetReader(const Datasets& datasets) : datasets_(datasets) {
+    }
+    NumberBuffer read(const string& name) override {
+        return find(name);
+    }
+    NumberBatches stream(const string& name, uint64_t start = 0) override {
+        if (start != 0) {
+            throw runtime_error{ "Datasets cannot be resumed from a byte offset" };
+        }
+        const NumberBuffer& numbers = find(name);
+        for (size_t begin = 0; begin < numbers.size(); begin += kStreamBatchSize) {
+            co_yield span<const int>(numbers.data() + begin, min(kStreamBatchSize, numbers.size() - begin));
+        }
+    }
+};
+
+class INumberFilter {
+public:
+    virtual ~INumberFilter() = default;
+    virtual bool keep(int number) const = 0;
+    virtual void keep_batch(const int* numbers, size_t count, unsigned char* selected) const {
+        for (size_t i = 0; i < count; ++i) {
+            selected[i] = keep(numbers[i]);
+        }
+    }
+};
+class EvenNumberFilter : public INumberFilter {
+public:
+    bool keep(int number) const override {
+        return number % 2 == 0;
+    }
+    void keep_batch(const int* numbers, size_t count, unsigned char* selected) const override {
+        for (size_t i = 0; i < count; ++i) {
+            selected[i] = (numbers[i] & 1) == 0;
+        }
+    }
+};
+class OddNumberFilter : public INumberFilter {
+public:
+    bool keep(int number) const override {
+        return number % 2 != 0;
+    }
+    void keep_batch(const int* numbers, size_t count, unsigned char* selected) const override {
+        for (size_t i = 0; i < count; ++i) {
+            selected[i] = (numbers[i] & 1) != 0;
+        }
+    }
+};
+class GreaterThanFilter : public INumberFilter {
+private:
+    int threshold_;
+public:
+    GreaterThanFilter(int threshold) : threshold_(threshold) {}
+    bool keep(int number) const override {
+        return number > threshold_;
+    }
+    void keep_batch(const int* numbers, size_t count, unsigned char* selected) const override {
+        for (size_t i = 0; i < count; ++i) {
+            selected[i] = numbers[i] > threshold_;
+        }
+    }
+};
+class LessThanFilter : public INumberFilter {
+private:
+    int threshold_;
+public:
+    LessThanFilter(int threshold) : threshold_(threshold) {}
+    bool keep(int number) const override {
+        return number < threshold_;
+    }
+    void keep_batch(const int* numbers, size_t count, unsigned char* selected) const override {
+        for (size_t i = 0; i < count; ++i) {
+            selected[i] = numbers[i] < threshold_;
+        }
+    }
+};
+class GreaterOrEqualFilter : public INumberFilter {
+private:
+    int threshold_;
+public:
+    GreaterOrEqualFilter(int threshold) : threshold_(threshold) {}
+    bool keep(int number) const override {
+        return number >= threshold_;
+    }
+    void keep_batch(const int* numbers, size_t count, unsigned char* selected) const override {
+        for (size_t i = 0; i < count; ++i) {
+            selected[i] = numbers[i] >= threshold_;
+        }
+    }
+};
+// low <= n <= high folded into a single unsigned compare: n - low wraps to a
+// huge value when n < low.
+class BetweenFilter : public INumberFilter {
+private:
+    uint32_t low_;
+    uint32_t span_;
+public:
+    BetweenFilter(int low, int high)
+        : low_(static_cast<uint32_t>(low)), span_(static_cast<uint32_t>(high) - static_cast<uint32_t>(low)) {
+        if (low > high) {
+            throw invalid_argument{ "BETWEEN filter requires low <= high" };
+        }
+    }
+    bool keep(int number) const override {
+        return static_cast<uint32_t>(number) - low_ <= span_;
+    }
+    void keep_batch(const int* numbers, size_t count, unsigned char* selected) const override {
+        for (size_t i = 0; i < count; ++i) {
+            selected[i] = static_cast<uint32_t>(numbers[i]) - low_ <= span_;
+        }
+    }
+};
+// Euclidean n mod k == r without a hardware divide. The number is biased by
+// 2^31 so that it is unsigned, the bias is folded into the expected remainder,
+// and the remainder itself uses Lemire's multiply-shift "fastmod" with a
+// multiplier computed once here.
+class ModuloFilter : public INumberFilter {
+private:
+    uint64_t multiplier_;
+    uint32_t divisor_;
+    uint32_t remainder_;
+
+    uint32_t fastmod(uint32_t value) const {
+        uint64_t fraction = multiplier_ * value;
+        return static_cast<uint32_t>(((fraction >> 32) * divisor_ + (((fraction & 0xFFFFFFFFull) * divisor_) >> 32)) >> 32);
+    }
+public:
+    ModuloFilter(int divisor, int remainder) {
+        if (divisor <= 0) {
+            throw invalid_argument{ "MOD filter requires a positive divisor" };
+        }
+        if (remainder < 0 || remainder >= divisor) {
+            throw invalid_argument{ "MOD filter requires 0 <= remainder < divisor" };
+        }
+        divisor_ = static_cast<uint32_t>(divisor);
+        multiplier_ = UINT64_C(0xFFFFFFFFFFFFFFFF) / divisor_ + 1;
+        remainder_ = static_cast<uint32_t>((remainder + UINT64_C(0x80000000) % divisor_) % divisor_);
+    }
+    bool keep(int number) const override {
+        return fastmod(static_cast<uint32_t>(number) ^ 0x80000000u) == remainder_;
+    }
+    void keep_batch(const int* numbers, size_t count, unsigned char* selected) const override {
+        for (size_t i = 0; i < count; ++i) {
+            selected[i] = fastmod(static_cast<uint32_t>(numbers[i]) ^ 0x80000000u) == remainder_;
+        }
+    }
+};
+class MaskFilter : public INumberFilter {
+private:
+    uint32_t mask_;
+    uint32_t value_;
+public:
+    MaskFilter(uint32_t mask, uint32_t value) : mask_(mask), value_(value) {}
+    bool keep(int number) const override {
+        return (static_cast<uint32_t>(number) & mask_) == value_;
+    }
+    void keep_batch(const int* numbers, size_t count, unsigned char* selected) const override {
+        for (size_t i = 0; i < count; ++i) {
+            selected[i] = (static_cast<uint32_t>(numbers[i]) & mask_) == value_;
+        }
+    }
+};
+class BloomFilter {
+private:
+    vector<uint64_t> words_;
+    uint64_t mask_ = 0;
+
+    static uint64_t hash(uint32_t value) {
+        uint64_t h = value * 0x9E3779B97F4A7C15ull;
+        h ^= h >> 29;
+        h *= 0xBF58476D1CE4E5B9ull;
+        return h ^ (h >> 32);
+    }
+    // Blocked layout: all three probe bits live in the same 64-bit word, so a
+    // lookup touches a single cache line.
+    static uint64_t bits(uint64_t h) {
+        return (1ull << ((h >> 40) & 63)) | (1ull << ((h >> 46) & 63)) | (1ull << ((h >> 52) & 63));
+    }
+
+public:
+    explicit BloomFilter(size_t expected_items) {
+        size_t words = 1;
+        while (words * 64 < expected_items * 10) {
+            words <<= 1;
+        }
+        words_.assign(words, 0);
+        mask_ = words - 1;
+    }
+    void add(uint32_t value) {
+        uint64_t h = hash(value);
+        words_[h & mask_] |= bits(h);
+    }
+    bool may_contain(uint32_t value) const {
+        uint64_t h = hash(value);
+        uint64_t b = bits(h);
+        return (words_[h & mask_] & b) == b;
+    }
+    void prefetch(uint32_t value) const {
+        PREFETCH(&words_[hash(value) & mask_]);
+    }
+};
+
+// Roaring-style bitmap: values are split by their high 16 bits into chunks,
+// each stored as a sorted array when sparse or a 65536-bit bitmap when dense.
+class RoaringBitmap {
+private:
+    static constexpr size_t kArrayLimit = 4096;
+    struct Container {
+        vector<uint16_t> array;
+        vector<uint64_t> bitmap;
+        bool contains(uint16_t low) const {
+            if (!bitmap.empty()) {
+                return (bitmap[low >> 6] >> (low & 63)) & 1;
+            }
+            return binary_search(array.begin(), array.end(), low);
+        }
+        // The word contains() reads for a bitmap, or the first probe of the
+        // binary search for an array.
+        const void* probe(uint16_t low) const {
+            return bitmap.empty() ? static_cast<const void*>(array.data() + array.size() / 2) : &bitmap[low >> 6];
+        }
+        void add(uint16_t low) {
+            if (!bitmap.empty()) {
+                bitmap[low >> 6] |= 1ull << (low & 63);
+                return;
+            }
+            auto it = lower_bound(array.begin(), array.end(), low);
+            if (it != array.end() && *it == low) {
+                return;
+            }
+            array.insert(it, low);
+            if (array.size() > kArrayLimit) {
+                bitmap.assign(1024, 0);
+                for (uint16_t value : array) {
+                    bitmap[value >> 6] |= 1ull << (value & 63);
+                }
+                vector<uint16_t>().swap(array);
+            }
+        }
+        size_t cardinality() const {
+            if (bitmap.empty()) {
+                return array.size();
+            }
+            size_t total = 0;
+            for (uint64_t word : bitmap) {
+                total += popcount(word);
+            }
+            return total;
+        }
+    };
+    vector<int32_t> index_ = vector<int32_t>(65536, -1);
+    vector<Container> containers_;
+
+public:
+    RoaringBitmap() = default;
+    explicit RoaringBitmap(vector<uint32_t> values) {
+        sort(values.begin(), values.end());
+        values.erase(unique(values.begin(), values.end()), values.end());
+        for (size_t begin = 0; begin < values.size();) {
+            uint32_t high = values[begin] >> 16;
+            size_t end = begin;
+            while (end < values.size() && (values[end] >> 16) == high) {
+                ++end;
+            }
+            Container container;
+            if (end - begin > kArrayLimit) {
+                container.bitmap.assign(1024, 0);
+                for (size_t i = begin; i < end; ++i) {
+                    uint16_t low = values[i] & 0xFFFF;
+                    container.bitmap[low >> 6] |= 1ull << (low & 63);
+                }
+            }
+            else {
+                for (size_t i = begin; i < end; ++i) {
+                    container.array.push_back(values[i] & 0xFFFF);
+                }
+            }
+            index_[high] = static_cast<int32_t>(containers_.size());
+            containers_.push_back(move(container));
+            begin = end;
+        }
+    }
+    bool contains(uint32_t value) const {
+        int32_t slot = index_[value >> 16];
+        return slot >= 0 && containers_[slot].contains(value & 0xFFFF);
+    }
+    void prefetch(uint32_t value) const {
+        int32_t slot = index_[value >> 16];
+        if (slot >= 0) {
+            PREFETCH(containers_[slot].probe(value & 0xFFFF));
+        }
+    }
+    void add(uint32_t value) {
+        int32_t& slot = index_[value >> 16];
+        if (slot < 0) {
+            slot = static_cast<int32_t>(containers_.size());
+            containers_.emplace_back();
+        }
+        containers_[slot].add(value & 0xFFFF);
+    }
+    void merge(const RoaringBitmap& other) {
+        for (uint32_t high = 0; high < 65536; ++high) {
+            int32_t slot = other.index_[high];
+            if (slot < 0) {
+                continue;
+            }
+            const Container& container = other.containers_[slot];
+            if (container.bitmap.empty()) {
+                for (uint16_t low : container.array) {
+                    add((high << 16) | low);
+                }
+                continue;
+            }
+            for (uint32_t word = 0; word < 1024; ++word) {
+                for (uint64_t bits = container.bitmap[word]; bits != 0; bits &= bits - 1) {
+                    add((high << 16) | (word << 6) | countr_zero(bits));
+                }
+            }
+        }
+    }
+    size_t cardinality() const {
+        size_t total = 0;
+        for (const Container& container : containers_) {
+            total += container.cardinality();
+        }
+        return total;
+    }
+    void save(ostream& out) const {
+        writeVector(out, index_);
+        writeValue<uint64_t>(out, containers_.size());
+        for (const Container& container : containers_) {
+            writeVector(out, container.array);
+            writeVector(out, container.bitmap);
+        }
+    }
+    void load(istream& in) {
+        vector<int32_t> index = readVector<int32_t>(in);
+        uint64_t count = readValue<uint64_t>(in);
+        if (index.size() != 65536 || count > 65536) {
+            throw runtime_error{ "Checkpoint bitmap is malformed" };
+        }
+        vector<Container> containers(count);
+        for (Container& container : containers) {
+            container.array = readVector<uint16_t>(in);
+            container.bitmap = readVector<uint64_t>(in);
+            if (!container.bitmap.empty() && container.bitmap.size() != 1024) {
+                throw runtime_error{ "Checkpoint bitmap is malformed" };
+            }
+        }
+        for (int32_t slot : index) {
+            if (slot < -1 || slot >= static_cast<int64_t>(containers.size())) {
+                throw runtime_error{ "Checkpoint bitmap is malformed" };
+            }
+        }
+        index_ = move(index);
+        containers_ = move(containers);
+    }
+};
+
+class SetMembershipFilter : public INumberFilter {
+private:
+    static constexpr size_t kPrefetchDistance = 16;
+    BloomFilter bloom_;
+    RoaringBitmap bitmap_;
+
+    static vector<uint32_t> loadValues(const string& filename) {
+        MappedFile file(filename);
+        vector<int> numbers = parseNumbers(file.view());
+        return vector<uint32_t>(numbers.begin(), numbers.end());
+    }
+
+    SetMembershipFilter(const vector<uint32_t>& values) : bloom_(values.size()), bitmap_(values) {
+        for (uint32_t value : values) {
+            bloom_.add(value);
+        }
+    }
+
+public:
+    explicit SetMembershipFilter(const string& filename) : SetMembershipFilter(loadValues(filename)) {}
+
+    bool keep(int number) const override {
+        uint32_t value = static_cast<uint32_t>(number);
+        return bloom_.may_contain(value) && bitmap_.contains(value);
+    }
+    void keep_batch(const int* numbers, size_t count, unsigned char* selected) const override {
+        for (size_t i = 0; i < count; ++i) {
+            if (i + kPrefetchDistance < count) {
+                bloom_.prefetch(static_cast<uint32_t>(numbers[i + kPrefetchDistance]));
+            }
+            selected[i] = bloom_.may_contain(static_cast<uint32_t>(numbers[i]));
+        }
+        for (size_t i = 0; i < count; ++i) {
+            if (i + kPrefetchDistance < count && selected[i + kPrefetchDistance]) {
+                bitmap_.prefetch(static_cast<uint32_t>(numbers[i + kPrefetchDistance]));
+            }
+            if (selected[i]) {
+                selected[i] = bitmap_.contains(static_cast<uint32_t>(numbers[i]));
+            }
+        }
+    }
+};
+pair<string, string> parseFilterSpec(const string& spec) {
+    if (size_t colon = spec.find(':'); colon != string::npos) {
+        return { spec.substr(0, colon), spec.substr(colon + 1) };
+    }
+    size_t name_end = 0;
+    while (name_end < spec.size() && isupper(static_cast<unsigned char>(spec[name_end]))) {
+        ++name_end;
+    }
+    return { spec.substr(0, name_end), spec.substr(name_end) };
+}
+
+// Conjunction of several predicates ("EVEN+GT10+MOD3,1"). For the first
+// kSampleBlocks blocks of every kResampleInterval, each predicate is run over the
+// whole block to measure its cost and selectivity. Afterwards the predicates are
+// ordered by cost / (1 - selectivity), and each later predicate only sees the
+// numbers that survived the earlier ones.
+class ConjunctionFilter : public INumberFilter {
+private:
+    static constexpr size_t kSampleBlocks = 4;
+    static constexpr size_t kResampleInterval = 256;
+    struct PredicateStats {
+        double nanos = 0;
+        size_t evaluated = 0;
+        size_t passed = 0;
+    };
+    vector<unique_ptr<INumberFilter>> predicates_;
+    // Shared adaptive state; keep_batch may run on several workers at once.
+    mutable mutex mutex_;
+    mutable vector<size_t> order_;
+    mutable vector<PredicateStats> stats_;
+    mutable size_t blocks_ = 0;
+    mutable size_t sampled_ = 0;
+
+    void sampleBlock(const int* numbers, size_t count, unsigned char* selected) const {
+        thread_local vector<unsigned char> scratch;
+        scratch.resize(count);
+        vector<PredicateStats> sample(predicates_.size());
+        fill(selected, selected + count, 1);
+        for (size_t p = 0; p < predicates_.size(); ++p) {
+            auto start = chrono::steady_clock::now();
+            predicates_[p]->keep_batch(numbers, count, scratch.data());
+            auto elapsed = chrono::steady_clock::now() - start;
+            size_t passed = 0;
+            for (size_t i = 0; i < count; ++i) {
+                passed += scratch[i];
+                selected[i] &= scratch[i];
+            }
+            sample[p] = PredicateStats{ chrono::duration<double, nano>(elapsed).count(), count, passed };
+        }
+        lock_guard<mutex> lock(mutex_);
+        for (size_t p = 0; p < predicates_.size(); ++p) {
+            stats_[p].nanos += sample[p].nanos;
+            stats_[p].evaluated += sample[p].evaluated;
+            stats_[p].passed += sample[p].passed;
+        }
+        if (++sampled_ == kSampleBlocks) {
+            reorder();
+        }
+    }
+
+    void reorder() const {
+        vector<double> rank(predicates_.size());
+        for (size_t p = 0; p < predicates_.size(); ++p) {
+            const PredicateStats& stats = stats_[p];
+            if (stats.evaluated == 0) {
+                return;
+            }
+            double cost = stats.nanos / stats.evaluated;
+            double rejected = 1.0 - static_cast<double>(stats.passed) / stats.evaluated;
+            rank[p] = cost / max(rejected, 1e-9);
+        }
+        stable_sort(order_.begin(), order_.end(), [&](size_t a, size_t b) { return rank[a] < rank[b]; });
+    }
+
+public:
+    explicit ConjunctionFilter(vector<unique_ptr<INumberFilter>> predicates)
+        : predicates_(move(predicates)), stats_(predicates_.size()) {
+        for (size_t p = 0; p < predicates_.size(); ++p) {
+            order_.push_back(p);
+        }
+    }
+
+    bool keep(int number) const override {
+        for (const auto& predicate : predicates_) {
+            if (!predicate->keep(number)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void keep_batch(const int* numbers, size_t count, unsigned char* selected) const override {
+        thread_local vector<size_t> order;
+        thread_local vector<unsigned char> scratch;
+        thread_local vector<int> survivors;
+        thread_local vector<uint32_t> positions;
+        bool sample = false;
+        {
+            lock_guard<mutex> lock(mutex_);
+            size_t phase = blocks_++ % kResampleInterval;
+            sample = phase < kSampleBlocks;
+            if (phase == 0) {
+                fill(stats_.begin(), stats_.end(), PredicateStats{});
+                sampled_ = 0;
+            }
+            order = order_;
+        }
+        if (sample) {
+            sampleBlock(numbers, count, selected);
+            return;
+        }
+
+        predicates_[order[0]]->keep_batch(numbers, count, selected);
+        survivors.clear();
+        positions.clear();
+        for (size_t i = 0; i < count; ++i) {
+            if (selected[i]) {
+                survivors.push_back(numbers[i]);
+                positions.push_back(static_cast<uint32_t>(i));
+            }
+        }
+        for (size_t k = 1; k < order.size() && !survivors.empty(); ++k) {
+            scratch.resize(survivors.size());
+            predicates_[order[k]]->keep_batch(survivors.data(), survivors.size(), scratch.data());
+            size_t kept = 0;
+            for (size_t j = 0; j < survivors.size(); ++j) {
+                survivors[kept] = survivors[j];
+                positions[kept] = positions[j];
+                kept += scratch[j];
+            }
+            survivors.resize(kept);
+            positions.resize(kept);
+        }
+        fill(selected, selected + count, 0);
+        for (uint32_t position : positions) {
+            selected[position] = 1;
+        }
+    }
+};
+
+// EXPR:<expression> over the number x, e.g. "x%3==0 && (x>100 || x<-100)".
+// Operators follow C precedence; comparisons and logical operators yield 0/1,
+// arithmetic is 64-bit wrapping and division by zero yields 0. The parsed tree
+// is evaluated per number by keep(). For batches it is compiled into a flat
+// register program whose instructions each run over a whole chunk, so the
+// per-node dispatch is paid once per chunk instead of once per number and the
+// inner loops are plain vectorizable array code.
+class ExpressionFilter : public INumberFilter {
+private:
+    enum class Op {
+        Input, Constant, Negate, Not, BitNot,
+        Mul, Div, Mod, Add, Sub, Less, LessEqual, Greater, GreaterEqual, Equal, NotEqual,
+        BitAnd, BitXor, BitOr, And, Or
+    };
+    struct Node {
+        Op op;
+        int64_t value = 0;
+        int lhs = -1;
+        int rhs = -1;
+    };
+    struct Instruction {
+        Op op;
+        int dst;
+        int lhs;
+        int rhs;          // -1 when the right operand is the immediate
+        int64_t imm = 0;
+    };
+    static constexpr size_t kChunkSize = 512;
+
+    vector<Node> nodes_;
+    int root_ = -1;
+    vector<Instruction> program_;
+    int result_register_ = 0;
+    int register_count_ = 1;
+
+    class Parser {
+    private:
+        const string& text_;
+        size_t pos_ = 0;
+        vector<Node>& nodes_;
+
+        void skipSpaces() {
+            while (pos_ < text_.size() && isspace(static_cast<unsigned char>(text_[pos_]))) {
+                ++pos_;
+            }
+        }
+        bool accept(const char* token) {
+            skipSpaces();
+            size_t length = char_traits<char>::length(token);
+            if (text_.compare(pos_, length, token) != 0) {
+                return false;
+            }
+            // Do not split "&&" into "&" or "<=" into "<".
+            if (length == 1 && pos_ + 1 < text_.size()) {
+                char next = text_[pos_ + 1];
+                if ((token[0] == '&' && next == '&') || (token[0] == '|' && next == '|') ||
+                    ((token[0] == '<' || token[0] == '>' || token[0] == '!' || token[0] == '=') && next == '=')) {
+                    return false;
+                }
+            }
+            pos_ += length;
+            return true;
+        }
+        int add(Op op, int lhs = -1, int rhs = -1, int64_t value = 0) {
+            nodes_.push_back(Node{ op, value, lhs, rhs });
+            return static_cast<int>(nodes_.size()) - 1;
+        }
+        [[noreturn]] void fail(const string& message) {
+            throw invalid_argument{ "Invalid EXPR filter at position " + to_string(pos_) + ": " + message + " in " + text_ };
+        }
+
+        using Level = int (Parser::*)();
+        int binary(Level next, initializer_list<pair<const char*, Op>> operators) {
+            int lhs = (this->*next)();
+            for (bool matched = true; matched;) {
+                matched = false;
+                for (const auto& [token, op] : operators) {
+                    if (accept(token)) {
+                        lhs = add(op, lhs, (this->*next)());
+                        matched = true;
+                        break;
+                    }
+                }
+            }
+            return lhs;
+        }
+        int logicalOr() { return binary(&Parser::logicalAnd, { { "||", Op::Or } }); }
+        int logicalAnd() { return binary(&Parser::bitOr, { { "&&", Op::And } }); }
+        int bitOr() { return binary(&Parser::bitXor, { { "|", Op::BitOr } }); }
+        int bitXor() { return binary(&Parser::bitAnd, { { "^", Op::BitXor } }); }
+        int bitAnd() { return binary(&Parser::equality, { { "&", Op::BitAnd } }); }
+        int equality() { return binary(&Parser::relational, { { "==", Op::Equal }, { "!=", Op::NotEqual } }); }
+        int relational() {
+            return binary(&Parser::additive, { { "<=", Op::LessEqual }, { ">=", Op::GreaterEqual }, { "<", Op::Less }, { ">", Op::Greater } });
+        }
+        int additive() { return binary(&Parser::multiplicative, { { "+", Op::Add }, { "-", Op::Sub } }); }
+        int multiplicative() { return binary(&Parser::unary, { { "*", Op::Mul }, { "/", Op::Div }, { "%", Op::Mod } }); }
+        int unary() {
+            if (accept("-")) {
+                return add(Op::Negate, unary());
+            }
+            if (accept("!")) {
+                return add(Op::Not, unary());
+            }
+            if (accept("~")) {
+                return add(Op::BitNot, unary());
+            }
+            return primary();
+        }
+        int primary() {
+            skipSpaces();
+            if (accept("(")) {
+                int inner = logicalOr();
+                if (!accept(")")) {
+                    fail("expected ')'");
+                }
+                return inner;
+            }
+            if (accept("x")) {
+                return add(Op::Input);
+            }
+            if (pos_ < text_.size() && isdigit(static_cast<unsigned char>(text_[pos_]))) {
+                bool hex = text_.compare(pos_, 2, "0x") == 0 || text_.compare(pos_, 2, "0X") == 0;
+                pos_ += hex ? 2 : 0;
+                int64_t value = 0;
+                auto [ptr, ec] = from_chars(text_.data() + pos_, text_.data() + text_.size(), value, hex ? 16 : 10);
+                if (ec != errc{}) {
+                    fail("number out of range");
+                }
+                pos_ = ptr - text_.data();
+                return add(Op::Constant, -1, -1, value);
+            }
+            fail("expected x, a number or '('");
+        }
+
+    public:
+        Parser(const string& text, vector<Node>& nodes) : text_(text), nodes_(nodes) {}
+        int parse() {
+            int root = logicalOr();
+            skipSpaces();
+            if (pos_ != text_.size()) {
+                fail("unexpected trailing input");
+            }
+            return root;
+        }
+    };
+
+    static int64_t apply(Op op, int64_t a, int64_t b) {
+        uint64_t ua = static_cast<uint64_t>(a);
+        uint64_t ub = static_cast<uint64_t>(b);
+        switch (op) {
+        case Op::Negate: return static_cast<int64_t>(0 - ua);
+        case Op::Not: return a == 0;
+        case Op::BitNot: return ~a;
+        case Op::Mul: return static_cast<int64_t>(ua * ub);
+        case Op::Div: return b == 0 ? 0 : (b == -1 ? static_cast<int64_t>(0 - ua) : a / b);
+        case Op::Mod: return b == 0 || b == -1 ? 0 : a % b;
+        case Op::Add: return static_cast<int64_t>(ua + ub);
+        case Op::Sub: return static_cast<int64_t>(ua - ub);
+        case Op::Less: return a < b;
+        case Op::LessEqual: return a <= b;
+        case Op::Greater: return a > b;
+        case Op::GreaterEqual: return a >= b;
+        case Op::Equal: return a == b;
+        case Op::NotEqual: return a != b;
+        case Op::BitAnd: return a & b;
+        case Op::BitXor: return a ^ b;
+        case Op::BitOr: return a | b;
+        case Op::And: return (a != 0) & (b != 0);
+        case Op::Or: return (a != 0) | (b != 0);
+        default: return 0;
+        }
+    }
+
+    int64_t evaluate(int node, int64_t x) const {
+        const Node& n = nodes_[node];
+        switch (n.op) {
+        case Op::Input: return x;
+        case Op::Constant: return n.value;
+        case Op::Negate:
+        case Op::Not:
+        case Op::BitNot: return apply(n.op, evaluate(n.lhs, x), 0);
+        default: return apply(n.op, evaluate(n.lhs, x), evaluate(n.rhs, x));
+        }
+    }
+
+    // Returns the register holding the node's value, or -1 with *constant set
+    // when the whole subtree folds to a constant. Register 0 is the input.
+    int compile(int node, int64_t* constant) {
+        const Node& n = nodes_[node];
+        if (n.op == Op::Input) {
+            return 0;
+        }
+        if (n.op == Op::Constant) {
+            *constant = n.value;
+            return -1;
+        }
+        int64_t lhs_constant = 0;
+        int64_t rhs_constant = 0;
+        int lhs = compile(n.lhs, &lhs_constant);
+        int rhs = n.rhs >= 0 ? compile(n.rhs, &rhs_constant) : -1;
+        bool unary = n.rhs < 0;
+        if (lhs < 0 && (unary || rhs < 0)) {
+            *constant = apply(n.op, lhs_constant, rhs_constant);
+            return -1;
+        }
+        if (lhs < 0) {
+            program_.push_back(Instruction{ Op::Constant, register_count_, -1, -1, lhs_constant });
+            lhs = register_count_++;
+        }
+        program_.push_back(Instruction{ n.op, register_count_, lhs, unary ? -1 : rhs, rhs_constant });
+        return register_count_++;
+    }
+
+    template <typename Fn>
+    static void run(int64_t* dst, const int64_t* a, const int64_t* b, int64_t imm, size_t count, Fn fn) {
+        if (b) {
+            for (size_t i = 0; i < count; ++i) {
+                dst[i] = fn(a[i], b[i]);
+            }
+        }
+        else {
+            for (size_t i = 0; i < count; ++i) {
+                dst[i] = fn(a[i], imm);
+            }
+        }
+    }
+
+    static void execute(const Instruction& ins, int64_t* registers, size_t count) {
+        int64_t* dst = &registers[ins.dst * kChunkSize];
+        const int64_t* a = ins.lhs >= 0 ? &registers[ins.lhs * kChunkSize] : nullptr;
+        const int64_t* b = ins.rhs >= 0 ? &registers[ins.rhs * kChunkSize] : nullptr;
+        using U = uint64_t;
+        switch (ins.op) {
+        case Op::Constant: fill(dst, dst + count, ins.imm); break;
+        case Op::Negate: run(dst, a, nullptr, 0, count, [](int64_t v, int64_t) { return static_cast<int64_t>(0 - U(v)); }); break;
+        case Op::Not: run(dst, a, nullptr, 0, count, [](int64_t v, int64_t) -> int64_t { return v == 0; }); break;
+        case Op::BitNot: run(dst, a, nullptr, 0, count, [](int64_t v, int64_t) { return ~v; }); break;
+        case Op::Mul: run(dst, a, b, ins.imm, count, [](int64_t l, int64_t r) { return static_cast<int64_t>(U(l) * U(r)); }); break;
+        case Op::Add: run(dst, a, b, ins.imm, count, [](int64_t l, int64_t r) { return static_cast<int64_t>(U(l) + U(r)); }); break;
+        case Op::Sub: run(dst, a, b, ins.imm, count, [](int64_t l, int64_t r) { return static_cast<int64_t>(U(l) - U(r)); }); break;
+        case Op::Less: run(dst, a, b, ins.imm, count, [](int64_t l, int64_t r) -> int64_t { return l < r; }); break;
+        case Op::LessEqual: run(dst, a, b, ins.imm, count, [](int64_t l, int64_t r) -> int64_t { return l <= r; }); break;
+        case Op::Greater: run(dst, a, b, ins.imm, count, [](int64_t l, int64_t r) -> int64_t { return l > r; }); break;
+        case Op::GreaterEqual: run(dst, a, b, ins.imm, count, [](int64_t l, int64_t r) -> int64_t { return l >= r; }); break;
+        case Op::Equal: run(dst, a, b, ins.imm, count, [](int64_t l, int64_t r) -> int64_t { return l == r; }); break;
+        case Op::NotEqual: run(dst, a, b, ins.imm, count, [](int64_t l, int64_t r) -> int64_t { return l != r; }); break;
+        case Op::BitAnd: run(dst, a, b, ins.imm, count, [](int64_t l, int64_t r) { return l & r; }); break;
+        case Op::BitXor: run(dst, a, b, ins.imm, count, [](int64_t l, int64_t r) { return l ^ r; }); break;
+        case Op::BitOr: run(dst, a, b, ins.imm, count, [](int64_t l, int64_t r) { return l | r; }); break;
+        case Op::And: run(dst, a, b, ins.imm, count, [](int64_t l, int64_t r) -> int64_t { return (l != 0) & (r != 0); }); break;
+        case Op::Or: run(dst, a, b, ins.imm, count, [](int64_t l, int64_t r) -> int64_t { return (l != 0) | (r != 0); }); break;
+        default: run(dst, a, b, ins.imm, count, [op = ins.op](int64_t l, int64_t r) { return apply(op, l, r); }); break;
+        }
+    }
+
+public:
+    explicit ExpressionFilter(const string& expression) {
+        if (expression.empty()) {
+            throw invalid_argument{ "EXPR filter requires an expression" };
+        }
+        root_ = Parser(expression, nodes_).parse();
+        int64_t constant = 0;
+        result_register_ = compile(root_, &constant);
+        if (result_register_ < 0) {
+            program_.push_back(Instruction{ Op::Constant, register_count_, -1, -1, constant });
+            result_register_ = register_count_++;
+        }
+    }
+
+    bool keep(int number) const override {
+        return evaluate(root_, number) != 0;
+    }
+
+    void keep_batch(const int* numbers, size_t count, unsigned char* selected) const override {
+        thread_local vector<int64_t> registers;
+        registers.resize(max(registers.size(), register_count_ * kChunkSize));
+        for (size_t begin = 0; begin < count; begin += kChunkSize) {
+            size_t chunk = min(kChunkSize, count - begin);
+            copy(numbers + begin, numbers + begin + chunk, registers.begin());
+            for (const Instruction& ins : program_) {
+                execute(ins, registers.data(), chunk);
+            }
+            const int64_t* result = &registers[result_register_ * kChunkSize];
+            for (size_t i = 0; i < chunk; ++i) {
+                selected[begin + i] = result[i] != 0;
+            }
+        }
+    }
+};
+
+vector<long long> parseFilterArgs(const string& filterName, const string& arg, size_t expected) {
+    vector<long long> values;
+    stringstream ss{ arg };
+    string token;
+    try {
+        while (getline(ss, token, ',')) {
+            bool hex = token.starts_with("0x") || token.starts_with("0X");
+            size_t used = 0;
+            values.push_back(stoll(token, &used, hex ? 16 : 10));
+            if (used != token.size()) {
+                throw invalid_argument{ token };
+            }
+        }
+    }
+    catch (const invalid_argument& e) {
+        throw invalid_argument{ "Invalid argument for " + filterName + " filter: " + arg };
+    }
+    catch (const out_of_range& e) {
+        throw out_of_range{ "Argument out of range for " + filterName + " filter: " + arg };
+    }
+    if (values.size() != expected) {
+        throw invalid_argument{ filterName + " filter expects " + to_string(expected) + " comma-separated argument(s): " + arg };
+    }
+    return values;
+}
+
+int toIntArg(const string& filterName, long long value) {
+    if (value < INT32_MIN || value > INT32_MAX) {
+        throw out_of_range{ "Argument out of range for " + filterName + " filter: " + to_string(value) };
+    }
+    return static_cast<int>(value);
+}
+
+uint32_t toBitsArg(const string& filterName, long long value) {
+    if (value < INT32_MIN || value > UINT32_MAX) {
+        throw out_of_range{ "Argument out of range for " + filterName + " filter: " + to_string(value) };
+    }
+    return static_cast<uint32_t>(value);
+}
+
+class FilterFactory {
+private:
+    using FilterCreator = function<unique_ptr<INumberFilter>(const string&)>;
+    map<string, FilterCreator> creators_;
+
+public:
+    FilterFactory() {
+        registerFilter("EVEN", [](const string&) { return make_unique<EvenNumberFilter>(); });
+        registerFilter("ODD", [](const string&) { return make_unique<OddNumberFilter>(); });
+        registerFilter("GT", [](const string& arg) {
+            try {
+                int threshold = stoi(arg);
+                return make_unique<GreaterThanFilter>(threshold);
+            }
+            catch (const invalid_argument& e) {
+                throw invalid_argument{ "Invalid argument for GT filter: " + arg };
+            }
+            catch (const out_of_range& e) {
+                throw out_of_range{ "Argument out of range for GT filter: " + arg };
+            }
+            });
+        registerFilter("IN", [](const string& arg) {
+            if (arg.empty()) {
+                throw invalid_argument{ "IN filter requires a file of values" };
+            }
+            return make_unique<SetMembershipFilter>(arg);
+            });
+        registerFilter("LT", [](const string& arg) {
+            return make_unique<LessThanFilter>(toIntArg("LT", parseFilterArgs("LT", arg, 1)[0]));
+            });
+        registerFilter("GE", [](const string& arg) {
+            return make_unique<GreaterOrEqualFilter>(toIntArg("GE", parseFilterArgs("GE", arg, 1)[0]));
+            });
+        registerFilter("BETWEEN", [](const string& arg) {
+            vector<long long> bounds = parseFilterArgs("BETWEEN", arg, 2);
+            return make_unique<BetweenFilter>(toIntArg("BETWEEN", bounds[0]), toIntArg("BETWEEN", bounds[1]));
+            });
+        registerFilter("MOD", [](const string& arg) {
+            vector<long long> params = parseFilterArgs("MOD", arg, 2);
+            return make_unique<ModuloFilter>(toIntArg("MOD", params[0]), toIntArg("MOD", params[1]));
+            });
+        registerFilter("MASK", [](const string& arg) {
+            vector<long long> params = parseFilterArgs("MASK", arg, 2);
+            return make_unique<MaskFilter>(toBitsArg("MASK", params[0]), toBitsArg("MASK", params[1]));
+            });
+        registerFilter("EXPR", [](const string& arg) { return make_unique<ExpressionFilter>(arg); });
+    }
+
+    void registerFilter(const string& filterName, FilterCreator creator) {
+        creators_[filterName] = creator;
+    }
+
+    unique_ptr<INumberFilter> createFilter(const string& filterType, const string& filterArg = "") const {
+        if (auto it = creators_.find(filterType); it != creators_.end()) {
+            return it->second(filterArg);
+        }
+        throw invalid_argument{ "Unknown filter type: " + filterType };
+    }
+
+    unique_ptr<INumberFilter> createFilterFromSpec(const string& spec) const {
+        vector<unique_ptr<INumberFilter>> predicates;
+        size_t begin = 0;
+        while (begin < spec.size()) {
+            // An expression may contain '+', so EXPR: consumes the rest of the spec.
+            size_t end = spec.compare(begin, 5, "EXPR:") == 0 ? string::npos : spec.find('+', begin);
+            string part = spec.substr(begin, end == string::npos ? string::npos : end - begin);
+            auto [filterType, filterArg] = parseFilterSpec(part);
+            if (!creators_.contains(filterType)) {
+                throw invalid_argument{ "Unknown filter type: " + part };
+            }
+            predicates.push_back(createFilter(filterType, filterArg));
+            begin = end == string::npos ? spec.size() : end + 1;
+        }
+        if (predicates.empty()) {
+            throw invalid_argument{ "Empty filter specification" };
+        }
+        if (predicates.size() == 1) {
+            return move(predicates.front());
+        }
+        return make_unique<ConjunctionFilter>(move(predicates));
+    }
+};
+class INumberObserver {
+public:
+    virtual ~INumberObserver() = default;
+    virtual void on_number(int number) = 0;
+    virtual void on_batch(const int* numbers, size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            on_number(numbers[i]);
+        }
+    }
+    virtual void on_finished() = 0;
+    // Called periodically during long or follow-mode runs to report progress so far.
+    virtual void on_snapshot() {}
+    // Returning true tells NumberProcessor this observer needs no more input;
+    // once every observer of a query is satisfied the query stops early.
+    virtual bool satisfied() const {
+        return false;
+    }
+    // Checkpoint hooks. The defaults suit stateless observers; observers that
+    // accumulate state override both, or throw runtime_error if they cannot.
+    virtual void save_state(ostream& /*out*/) const {}
+    virtual void load_state(istream& /*in*/) {}
+};
+
+
+class PrintObserver : public INumberObserver {
+private:
+    string prefix_;
+public:
+    PrintObserver(const string& label = "") : prefix_(label.empty() ? "" : "[" + label + "] ") {}
+    void on_number(int number) override {
+        cout << prefix_ << "Read and filtered number: " << number << endl;
+    }
+    void on_finished() override {
+        cout << prefix_ << "Number processing finished.\n";
+    }
+};
+
+
+class CountObserver : public INumberObserver {
+private:
+    string prefix_;
+    int count_ = 0;
+public:
+    CountObserver(const string& label = "") : prefix_(label.empty() ? "" : "[" + label + "] ") {}
+    void on_number(int number) override {
+        count_++;
+    }
+    void on_snapshot() override {
+        cout << prefix_ << "Filtered numbers so far: " << count_ << endl;
+    }
+    void save_state(ostream& out) const override {
+        writeValue(out, count_);
+    }
+    void load_state(istream& in) override {
+        count_ = readValue<int>(in);
+    }
+    void on_finished() override {
+        cout << prefix_ << "Total number of filtered numbers: " << count_ << endl;
+    }
+};
+
+// Keeps the K largest matches in a bounded min-heap. Each chunk of a batch is
+// first reduced to its maximum (a vectorizable loop) and skipped entirely when
+// nothing in it can displace the current heap minimum.
+class TopKObserver : public INumberObserver {
+private:
+    static constexpr size_t kChunkSize = 256;
+    string prefix_;
+    size_t k_;
+    vector<int> heap_;
+
+    void push(int number) {
+        if (heap_.size() < k_) {
+            heap_.push_back(number);
+            push_heap(heap_.begin(), heap_.end(), greater<int>());
+        }
+        else if (number > heap_.front()) {
+            pop_heap(heap_.begin(), heap_.end(), greater<int>());
+            heap_.back() = number;
+            push_heap(heap_.begin(), heap_.end(), greater<int>());
+        }
+    }
+
+public:
+    TopKObserver(size_t k, const string& label = "") : prefix_(label.empty() ? "" : "[" + label + "] "), k_(k) {
+        heap_.reserve(k_);
+    }
+    void on_number(int number) override {
+        push(number);
+    }
+    void on_batch(const int* numbers, size_t count) override {
+        for (size_t begin = 0; begin < count; begin += kChunkSize) {
+            size_t end = min(count, begin + kChunkSize);
+            if (heap_.size() == k_) {
+                int best = numbers[begin];
+                for (size_t i = begin; i < end; ++i) {
+                    best = max(best, numbers[i]);
+                }
+                if (best <= heap_.front()) {
+                    continue;
+                }
+            }
+            for (size_t i = begin; i < end; ++i) {
+                push(numbers[i]);
+            }
+        }
+    }
+    void merge(const TopKObserver& other) {
+        for (int number : other.heap_) {
+            push(number);
+        }
+    }
+    void save_state(ostream& out) const override {
+        writeVector(out, heap_);
+    }
+    void load_state(istream& in) override {
+        heap_.clear();
+        for (int number : readVector<int>(in)) {
+            push(number);
+        }
+    }
+    vector<int> values() const {
+        vector<int> sorted = heap_;
+        sort(sorted.begin(), sorted.end(), greater<int>());
+        return sorted;
+    }
+    void on_snapshot() override {
+        cout << prefix_ << "Top " << k_ << " filtered numbers so far:";
+        for (int number : values()) {
+            cout << ' ' << number;
+        }
+        cout << endl;
+    }
+    void on_finished() override {
+        cout << prefix_ << "Top " << k_ << " filtered numbers:";
+        for (int number : values()) {
+            cout << ' ' << number;
+        }
+        cout << endl;
+    }
+};
+
+class CountMinSketch {
+private:
+    static constexpr size_t kDepth = 4;
+    size_t width_;
+    vector<uint32_t> counters_;
+
+    static uint32_t hash(uint32_t value, size_t row) {
+        uint64_t h = (value + 0x9E3779B97F4A7C15ull * (row + 1)) * 0xBF58476D1CE4E5B9ull;
+        return static_cast<uint32_t>(h >> 32);
+    }
+
+public:
+    explicit CountMinSketch(size_t width) : width_(width), counters_(kDepth * width, 0) {}
+    uint32_t add(int number) {
+        uint32_t estimate = UINT32_MAX;
+        for (size_t row = 0; row < kDepth; ++row) {
+            uint32_t& counter = counters_[row * width_ + hash(static_cast<uint32_t>(number), row) % width_];
+            estimate = min(estimate, ++counter);
+        }
+        return estimate;
+    }
+    uint32_t estimate(int number) const {
+        uint32_t estimate = UINT32_MAX;
+        for (size_t row = 0; row < kDepth; ++row) {
+            estimate = min(estimate, counters_[row * width_ + hash(static_cast<uint32_t>(number), row) % width_]);
+        }
+        return estimate;
+    }
+    void merge(const CountMinSketch& other) {
+        for (size_t i = 0; i < counters_.size(); ++i) {
+            counters_[i] += other.counters_[i];
+        }
+    }
+    void save(ostream& out) const {
+        writeVector(out, counters_);
+    }
+    void load(istream& in) {
+        vector<uint32_t> counters = readVector<uint32_t>(in);
+        if (counters.size() != counters_.size()) {
+            throw runtime_error{ "Checkpoint sketch size does not match" };
+        }
+        counters_ = move(counters);
+    }
+};
+
+// SpaceSaving over K counters kept in an indexed min-heap. A new value evicts
+// the minimum counter and starts at min + 1, with min as its error. A Count-Min
+// sketch runs alongside; its estimate only tightens the reported upper bounds.
+class HeavyHittersObserver : public INumberObserver {
+private:
+    struct Counter {
+        int value;
+        uint64_t count;
+        uint64_t error;
+    };
+    string prefix_;
+    size_t k_;
+    vector<Counter> heap_;
+    unordered_map<int, size_t> positions_;
+    CountMinSketch sketch_;
+
+    void swapCounters(size_t a, size_t b) {
+        swap(heap_[a], heap_[b]);
+        positions_[heap_[a].value] = a;
+        positions_[heap_[b].value] = b;
+    }
+    void siftDown(size_t i) {
+        for (;;) {
+            size_t smallest = i;
+            for (size_t child = 2 * i + 1; child <= 2 * i + 2 && child < heap_.size(); ++child) {
+                if (heap_[child].count < heap_[smallest].count) {
+                    smallest = child;
+                }
+            }
+            if (smallest == i) {
+                return;
+            }
+            swapCounters(i, smallest);
+            i = smallest;
+        }
+    }
+    void siftUp(size_t i) {
+        while (i > 0 && heap_[(i - 1) / 2].count > heap_[i].count) {
+            swapCounters(i, (i - 1) / 2);
+            i = (i - 1) / 2;
+        }
+    }
+    void offer(int number, uint64_t weight) {
+        if (auto it = positions_.find(number); it != positions_.end()) {
+            heap_[it->second].count += weight;
+            siftDown(it->second);
+        }
+        else if (heap_.size() < k_) {
+            positions_[number] = heap_.size();
+            heap_.push_back(Counter{ number, weight, 0 });
+            siftUp(heap_.size() - 1);
+        }
+        else {
+            uint64_t floor = heap_.front().count;
+            positions_.erase(heap_.front().value);
+            heap_.front() = Counter{ number, floor + weight, floor };
+            positions_[number] = 0;
+            siftDown(0);
+        }
+    }
+
+public:
+    HeavyHittersObserver(size_t k, const string& label = "")
+        : prefix_(label.empty() ? "" : "[" + label + "] "), k_(k), sketch_(max<size_t>(1024, 8 * k)) {
+        heap_.reserve(k_);
+        positions_.reserve(k_);
+    }
+    void on_number(int number) override {
+        sketch_.add(number);
+        offer(number, 1);
+    }
+    // SpaceSaving merge: a value the other side does not track may have
+    // occurred there up to that side's minimum (once it has evicted anything),
+    // so that minimum is added to both its count and its error; the K largest
+    // combined counters are kept.
+    void merge(const HeavyHittersObserver& other) {
+        sketch_.merge(other.sketch_);
+        uint64_t floor = heap_.size() < k_ ? 0 : heap_.front().count;
+        uint64_t other_floor = other.heap_.size() < other.k_ ? 0 : other.heap_.front().count;
+        unordered_map<int, Counter> combined;
+        for (const Counter& counter : heap_) {
+            combined[counter.value] = Counter{ counter.value, counter.count + other_floor, counter.error + other_floor };
+        }
+        for (const Counter& counter : other.heap_) {
+            auto [it, inserted] = combined.try_emplace(counter.value, Counter{ counter.value, floor, floor });
+            if (!inserted) {
+                it->second.count -= other_floor;
+                it->second.error -= other_floor;
+            }
+            it->second.count += counter.count;
+            it->second.error += counter.error;
+        }
+        vector<Counter> counters;
+        counters.reserve(combined.size());
+        for (const auto& [value, counter] : combined) {
+            counters.push_back(counter);
+        }
+        size_t keep = min(k_, counters.size());
+        partial_sort(counters.begin(), counters.begin() + keep, counters.end(), [](const Counter& a, const Counter& b) { return a.count > b.count; });
+        counters.resize(keep);
+        heap_.clear();
+        positions_.clear();
+        for (const Counter& counter : counters) {
+            positions_[counter.value] = heap_.size();
+            heap_.push_back(counter);
+            siftUp(heap_.size() - 1);
+        }
+    }
+    void save_state(ostream& out) const override {
+        writeValue<uint64_t>(out, heap_.size());
+        for (const Counter& counter : heap_) {
+            writeValue(out, counter.value);
+            writeValue(out, counter.count);
+            writeValue(out, counter.error);
+        }
+        sketch_.save(out);
+    }
+    void load_state(istream& in) override {
+        uint64_t size = readValue<uint64_t>(in);
+        if (size > k_) {
+            throw runtime_error{ "Checkpoint heavy hitters do not match" };
+        }
+        heap_.clear();
+        positions_.clear();
+        for (uint64_t i = 0; i < size; ++i) {
+            Counter counter;
+            counter.value = readValue<int>(in);
+            counter.count = readValue<uint64_t>(in);
+            counter.error = readValue<uint64_t>(in);
+            positions_[counter.value] = heap_.size();
+            heap_.push_back(counter);
+        }
+        sketch_.load(in);
+    }
+    void on_finished() override {
+        cout << prefix_ << "Most frequent filtered numbers:\n";
+        // The sketch never underestimates, so it can lower a counter's upper
+        // bound; the lower bound, count - error, is unchanged.
+        vector<Counter> sorted = heap_;
+        for (Counter& counter : sorted) {
+            uint64_t bound = min<uint64_t>(counter.count, sketch_.estimate(counter.value));
+            counter.error -= min(counter.error, counter.count - bound);
+            counter.count = bound;
+        }
+        sort(sorted.begin(), sorted.end(), [](const Counter& a, const Counter& b) { return a.count > b.count; });
+        for (const Counter& counter : sorted) {
+            cout << prefix_ << "  " << counter.value << ": " << counter.count;
+            if (counter.error > 0) {
+                cout << " (overestimated by at most " << counter.error << ")";
+            }
+            cout << '\n';
+        }
+        cout.flush();
+    }
+};
+
+class HyperLogLog {
+private:
+    int precision_;
+    vector<uint8_t> registers_;
+    vector<uint64_t> hashes_;
+
+    static uint64_t hash(uint32_t value) {
+        uint64_t h = value + 0x9E3779B97F4A7C15ull;
+        h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ull;
+        h = (h ^ (h >> 27)) * 0x94D049BB133111EBull;
+        return h ^ (h >> 31);
+    }
+    void update(uint64_t h) {
+        size_t index = h >> (64 - precision_);
+        uint8_t rank = static_cast<uint8_t>(countl_zero((h << precision_) | (1ull << (precision_ - 1))) + 1);
+        registers_[index] = max(registers_[index], rank);
+    }
+
+public:
+    explicit HyperLogLog(int precision) : precision_(precision), registers_(size_t{ 1 } << precision, 0) {}
+    int precision() const {
+        return precision_;
+    }
+    void add(int number) {
+        update(hash(static_cast<uint32_t>(number)));
+    }
+    // Hashing is done as a separate pass so that it vectorizes; only the
+    // register max-update is a scatter.
+    void add_batch(const int* numbers, size_t count) {
+        hashes_.resize(count);
+        for (size_t i = 0; i < count; ++i) {
+            hashes_[i] = hash(static_cast<uint32_t>(numbers[i]));
+        }
+        for (size_t i = 0; i < count; ++i) {
+            update(hashes_[i]);
+        }
+    }
+    void merge(const HyperLogLog& other) {
+        if (other.precision_ != precision_) {
+            throw invalid_argument{ "Cannot merge HyperLogLog sketches of different precision" };
+        }
+        for (size_t i = 0; i < registers_.size(); ++i) {
+            registers_[i] = max(registers_[i], other.registers_[i]);
+        }
+    }
+    double estimate() const {
+        double m = static_cast<double>(registers_.size());
+        double sum = 0;
+        size_t zeros = 0;
+        for (uint8_t rank : registers_) {
+            sum += ldexp(1.0, -rank);
+            zeros += rank == 0;
+        }
+        double alpha = m == 16 ? 0.673 : m == 32 ? 0.697 : m == 64 ? 0.709 : 0.7213 / (1 + 1.079 / m);
+        double raw = alpha * m * m / sum;
+        if (raw <= 2.5 * m && zeros > 0) {
+            return m * log(m / zeros);
+        }
+        return raw;
+    }
+    void save(ostream& out) const {
+        writeVector(out, registers_);
+    }
+    void load(istream& in) {
+        vector<uint8_t> registers = readVector<uint8_t>(in);
+        if (registers.size() != registers_.size()) {
+            throw runtime_error{ "Checkpoint HyperLogLog precision does not match" };
+        }
+        registers_ = move(registers);
+    }
+    double relative_error() const {
+        return 1.04 / sqrt(static_cast<double>(registers_.size()));
+    }
+};
+
+// DISTINCT counts exact cardinality in a Roaring-style bitmap;
+// DISTINCT:hll[p] estimates it with a 2^p-register HyperLogLog (default p=14).
+class DistinctObserver : public INumberObserver {
+private:
+    string prefix_;
+    unique_ptr<RoaringBitmap> exact_;
+    unique_ptr<HyperLogLog> sketch_;
+
+public:
+    DistinctObserver(int hll_precision, const string& label = "") : prefix_(label.empty() ? "" : "[" + label + "] ") {
+        if (hll_precision == 0) {
+            exact_ = make_unique<RoaringBitmap>();
+        }
+        else if (hll_precision < 4 || hll_precision > 18) {
+            throw invalid_argument{ "DISTINCT observer HyperLogLog precision must be between 4 and 18" };
+        }
+        else {
+            sketch_ = make_unique<HyperLogLog>(hll_precision);
+        }
+    }
+    void on_number(int number) override {
+        if (exact_) {
+            exact_->add(static_cast<uint32_t>(number));
+        }
+        else {
+            sketch_->add(number);
+        }
+    }
+    void on_batch(const int* numbers, size_t count) override {
+        if (exact_) {
+            for (size_t i = 0; i < count; ++i) {
+                exact_->add(static_cast<uint32_t>(numbers[i]));
+            }
+        }
+        else {
+            sketch_->add_batch(numbers, count);
+        }
+    }
+    void merge(const DistinctObserver& other) {
+        if (exact_ && other.exact_) {
+            exact_->merge(*other.exact_);
+        }
+        else if (sketch_ && other.sketch_) {
+            sketch_->merge(*other.sketch_);
+        }
+        else {
+            throw invalid_argument{ "Cannot merge exact and approximate DISTINCT observers" };
+        }
+    }
+    void save_state(ostream& out) const override {
+        if (exact_) {
+            exact_->save(out);
+        }
+        else {
+            sketch_->save(out);
+        }
+    }
+    void load_state(istream& in) override {
+        if (exact_) {
+            exact_->load(in);
+        }
+        else {
+            sketch_->load(in);
+        }
+    }
+    void on_snapshot() override {
+        cout << prefix_ << "Distinct filtered numbers so far: "
+            << (exact_ ? exact_->cardinality() : static_cast<size_t>(llround(sketch_->estimate()))) << endl;
+    }
+    void on_finished() override {
+        if (exact_) {
+            cout << prefix_ << "Distinct filtered numbers: " << exact_->cardinality() << endl;
+        }
+        else {
+            cout << prefix_ << "Estimated distinct filtered numbers: " << llround(sketch_->estimate())
+                << " (HyperLogLog p=" << sketch_->precision() << ", standard error "
+                << fixed << setprecision(2) << sketch_->relative_error() * 100 << "%)" << defaultfloat << endl;
+        }
+    }
+};
+
+template <typename Fn>
+void parallelFor(unsigned workers, Fn fn) {
+    if (workers <= 1) {
+        fn(0u);
+        return;
+    }
+    TaskGroup group;
+    for (unsigned worker = 1; worker < workers; ++worker) {
+        group.run([&fn, worker] { fn(worker); });
+    }
+    fn(0u);
+    group.wait();
+}
+
+// LSD radix sort over four 8-bit digits of the sign-flipped key. Each worker
+// histograms its own slice, the per-(digit, worker) prefix sums give every
+// worker a private output range, and the scatter runs in parallel. Passes in
+// which every key shares the same digit are skipped.
+void parallelRadixSort(span<int> values, unsigned workers) {
+    constexpr size_t kRadix = 256;
+    constexpr size_t kMinPerWorker = 1 << 16;
+    size_t n = values.size();
+    if (n < 2) {
+        return;
+    }
+    workers = static_cast<unsigned>(max<size_t>(1, min<size_t>(workers, n / kMinPerWorker)));
+    uint32_t* keys = reinterpret_cast<uint32_t*>(values.data());
+    vector<uint32_t, HugePageAllocator<uint32_t>> scratch(n);
+    uint32_t* source = keys;
+    uint32_t* target = scratch.data();
+    vector<array<size_t, kRadix>> histograms(workers);
+    auto slice = [&](unsigned worker) { return pair<size_t, size_t>{ n * worker / workers, n * (worker + 1) / workers }; };
+
+    for (size_t i = 0; i < n; ++i) {
+        keys[i] ^= 0x80000000u;
+    }
+    for (int shift = 0; shift < 32; shift += 8) {
+        parallelFor(workers, [&](unsigned worker) {
+            auto [begin, end] = slice(worker);
+            array<size_t, kRadix>& histogram = histograms[worker];
+            histogram.fill(0);
+            for (size_t i = begin; i < end; ++i) {
+                ++histogram[(source[i] >> shift) & 0xFF];
+            }
+            });
+        bool trivial = false;
+        size_t offset = 0;
+        for (size_t digit = 0; digit < kRadix; ++digit) {
+            size_t total = 0;
+            for (unsigned worker = 0; worker < workers; ++worker) {
+                size_t count = histograms[worker][digit];
+                histograms[worker][digit] = offset + total;
+                total += count;
+            }
+            trivial = trivial || total == n;
+            offset += total;
+        }
+        if (trivial) {
+            continue;
+        }
+        parallelFor(workers, [&](unsigned worker) {
+            auto [begin, end] = slice(worker);
+            array<size_t, kRadix>& offsets = histograms[worker];
+            for (size_t i = begin; i < end; ++i) {
+                target[offsets[(source[i] >> shift) & 0xFF]++] = source[i];
+            }
+            });
+        swap(source, target);
+    }
+    if (source != keys) {
+        copy(source, source + n, keys);
+    }
+    for (size_t i = 0; i < n; ++i) {
+        keys[i] ^= 0x80000000u;
+    }
+}
+
+// Writes the matches in ascending order at on_finished, one per line. Matches
+// are buffered up to half of the memory budget (the radix sort needs the other
+// half as scratch); beyond that each full buffer is sorted and spilled to a
+// temporary run file, and the runs are k-way merged at the end.
+class SortedOutputObserver : public INumberObserver {
+private:
+    static constexpr size_t kRunBufferSize = 1 << 16;
+    string prefix_;
+    size_t capacity_;
+    unsigned workers_;
+    NumberBuffer buffer_;
+    vector<filesystem::path> runs_;
+
+    class RunReader {
+    private:
+        ifstream file_;
+        vector<int> buffer_ = vector<int>(kRunBufferSize);
+        size_t pos_ = 0;
+        size_t size_ = 0;
+    public:
+        explicit RunReader(const filesystem::path& path) : file_(path, ios::binary) {
+            if (!file_.is_open()) {
+                throw runtime_error{ "Could not open sort run: " + path.string() };
+            }
+        }
+        bool next(int& value) {
+            if (pos_ == size_) {
+                file_.read(reinterpret_cast<char*>(buffer_.data()), buffer_.size() * sizeof(int));
+                size_ = static_cast<size_t>(file_.gcount()) / sizeof(int);
+                pos_ = 0;
+                if (size_ == 0) {
+                    return false;
+                }
+            }
+            value = buffer_[pos_++];
+            return true;
+        }
+    };
+
+    void spill() {
+        parallelRadixSort(buffer_, workers_);
+        random_device entropy;
+        filesystem::path path = filesystem::temp_directory_path() /
+            ("sorted_run_" + to_string(entropy()) + "_" + to_string(runs_.size()) + ".bin");
+        ofstream file(path, ios::binary);
+        file.write(reinterpret_cast<const char*>(buffer_.data()), buffer_.size() * sizeof(int));
+        if (!file) {
+            throw runtime_error{ "Could not write sort run: " + path.string() };
+        }
+        runs_.push_back(path);
+        buffer_.clear();
+    }
+
+    void write(string& out, int number) {
+        if (out.size() > (1 << 16)) {
+            cout.write(out.data(), out.size());
+            out.clear();
+        }
+        char digits[16];
+        auto [end, ec] = to_chars(digits, digits + sizeof(digits), number);
+        out += prefix_;
+        out.append(digits, end);
+        out += '\n';
+    }
+
+    void mergeRuns(string& out) {
+        vector<unique_ptr<RunReader>> readers;
+        using Head = pair<int, size_t>;
+        priority_queue<Head, vector<Head>, greater<Head>> heads;
+        for (const filesystem::path& path : runs_) {
+            readers.push_back(make_unique<RunReader>(path));
+            if (int value; readers.back()->next(value)) {
+                heads.emplace(value, readers.size() - 1);
+            }
+        }
+        while (!heads.empty()) {
+            auto [value, run] = heads.top();
+            heads.pop();
+            write(out, value);
+            if (int next; readers[run]->next(next)) {
+                heads.emplace(next, run);
+            }
+        }
+    }
+
+public:
+    SortedOutputObserver(size_t memory_budget_bytes, const string& label = "")
+        : prefix_(label.empty() ? "" : "[" + label + "] "),
+        capacity_(max<size_t>(1, memory_budget_bytes / (2 * sizeof(int)))),
+        workers_(max(1u, thread::hardware_concurrency())) {
+    }
+    ~SortedOutputObserver() override {
+        for (const filesystem::path& path : runs_) {
+            error_code ignored;
+            filesystem::remove(path, ignored);
+        }
+    }
+    void on_number(int number) override {
+        on_batch(&number, 1);
+    }
+    void on_batch(const int* numbers, size_t count) override {
+        while (count > 0) {
+            size_t take = min(count, capacity_ - buffer_.size());
+            buffer_.insert(buffer_.end(), numbers, numbers + take);
+            numbers += take;
+            count -= take;
+            if (buffer_.size() == capacity_) {
+                spill();
+            }
+        }
+    }
+    void save_state(ostream& out) const override {
+        if (!runs_.empty()) {
+            throw runtime_error{ "SORTED observer cannot checkpoint after spilling to disk" };
+        }
+        writeVector(out, buffer_);
+    }
+    void load_state(istream& in) override {
+        vector<int> buffer = readVector<int>(in);
+        buffer_.assign(buffer.begin(), buffer.end());
+    }
+    void on_finished() override {
+        string out;
+        if (runs_.empty()) {
+            parallelRadixSort(buffer_, workers_);
+            for (int number : buffer_) {
+                write(out, number);
+            }
+        }
+        else {
+            if (!buffer_.empty()) {
+                spill();
+            }
+            mergeRuns(out);
+        }
+        cout.write(out.data(), out.size());
+        cout.flush();
+    }
+};
+
+struct WindowStats {
+    uint64_t first = 0;
+    uint64_t count = 0;
+    int64_t sum = 0;
+    int min = 0;
+    int max = 0;
+};
+
+void printWindow(const string& prefix, const WindowStats& window, bool partial) {
+    cout << prefix << "Window " << window.first + 1 << "-" << window.first + window.count
+        << (partial ? " (partial)" : "") << ": count=" << window.count << " sum=" << window.sum
+        << " min=" << window.min << " max=" << window.max << '\n';
+}
+
+// TUMBLING:N reports count/sum/min/max for each consecutive block of N matches
+// as soon as the block is complete.
+class TumblingWindowObserver : public INumberObserver {
+private:
+    string prefix_;
+    uint64_t size_;
+    WindowStats window_;
+public:
+    TumblingWindowObserver(size_t size, const string& label = "") : prefix_(label.empty() ? "" : "[" + label + "] "), size_(size) {}
+    void on_number(int number) override {
+        window_.min = window_.count == 0 ? number : min(window_.min, number);
+        window_.max = window_.count == 0 ? number : max(window_.max, number);
+        window_.sum += number;
+        if (++window_.count == size_) {
+            printWindow(prefix_, window_, false);
+            window_ = WindowStats{ window_.first + size_ };
+        }
+    }
+    void save_state(ostream& out) const override {
+        writeValue(out, window_);
+    }
+    void load_state(istream& in) override {
+        window_ = readValue<WindowStats>(in);
+    }
+    void on_finished() override {
+        if (window_.count > 0) {
+            printWindow(prefix_, window_, true);
+        }
+        cout.flush();
+    }
+};
+
+// SLIDING:N[,step] reports count/sum/min/max over the last N matches every
+// step matches. The sum is kept incrementally (add the new value, subtract the
+// one leaving the ring), and min/max come from monotonic deques, so each
+// update is O(1) amortized regardless of N.
+class SlidingWindowObserver : public INumberObserver {
+private:
+    string prefix_;
+    uint64_t size_;
+    uint64_t step_;
+    vector<int> ring_;
+    uint64_t total_ = 0;
+    int64_t sum_ = 0;
+    deque<pair<uint64_t, int>> minimums_;
+    deque<pair<uint64_t, int>> maximums_;
+
+    WindowStats current() const {
+        uint64_t count = min(total_, size_);
+        return WindowStats{ total_ - count, count, sum_, minimums_.front().second, maximums_.front().second };
+    }
+
+    void push(int number) {
+        if (total_ >= size_) {
+            sum_ -= ring_[total_ % size_];
+            uint64_t expired = total_ - size_;
+            if (minimums_.front().first == expired) {
+                minimums_.pop_front();
+            }
+            if (maximums_.front().first == expired) {
+                maximums_.pop_front();
+            }
+        }
+        ring_[total_ % size_] = number;
+        sum_ += number;
+        while (!minimums_.empty() && minimums_.back().second >= number) {
+            minimums_.pop_back();
+        }
+        minimums_.emplace_back(total_, number);
+        while (!maximums_.empty() && maximums_.back().second <= number) {
+            maximums_.pop_back();
+        }
+        maximums_.emplace_back(total_, number);
+        ++total_;
+    }
+
+public:
+    SlidingWindowObserver(size_t size, size_t step, const string& label = "")
+        : prefix_(label.empty() ? "" : "[" + label + "] "), size_(size), step_(step), ring_(size) {
+    }
+    void on_number(int number) override {
+        push(number);
+        if (total_ >= size_ && (total_ - size_) % step_ == 0) {
+            printWindow(prefix_, current(), false);
+        }
+    }
+    // The window contents are saved oldest first and replayed on load, which
+    // rebuilds the running sum and the min/max deques.
+    void save_state(ostream& out) const override {
+        uint64_t count = min(total_, size_);
+        vector<int> window;
+        for (uint64_t i = total_ - count; i < total_; ++i) {
+            window.push_back(ring_[i % size_]);
+        }
+        writeValue(out, total_);
+        writeVector(out, window);
+    }
+    void load_state(istream& in) override {
+        uint64_t total = readValue<uint64_t>(in);
+        vector<int> window = readVector<int>(in);
+        if (window.size() > size_ || window.size() > total) {
+            throw runtime_error{ "Checkpoint window does not match" };
+        }
+        total_ = total - window.size();
+        sum_ = 0;
+        minimums_.clear();
+        maximums_.clear();
+        for (int number : window) {
+            push(number);
+        }
+    }
+    void on_finished() override {
+        if (total_ > 0 && total_ < size_) {
+            printWindow(prefix_, current(), true);
+        }
+        cout.flush();
+    }
+};
+
+// Writes the matches to a file that a later run can read back: text with one
+// number per line, or the binary number format when the name ends in .bin; a
+// further .zst suffix compresses either with zstd. Output is staged in a 1 MiB
+// buffer and written in whole blocks. The file is opened on the first write so
+// that a resumed checkpoint can truncate it to the saved length instead.
+class FileOutputObserver : public INumberObserver {
+private:
+    static constexpr size_t kBufferSize = 1 << 20;
+    static constexpr int kZstdLevel = 3;
+    string prefix_;
+    string path_;
+    bool binary_;
+    bool compressed_;
+    // Mutable so the const save_state can flush plain output before it
+    // records the file size.
+    mutable ofstream file_;
+    vector<char> buffer_;
+    mutable size_t used_ = 0;
+    mutable uint64_t written_ = 0;
+    uint64_t count_ = 0;
+    optional<uint64_t> resume_at_;
+    void* zstd_stream_ = nullptr;
+    vector<char> zstd_output_;
+
+    static string labelledPath(const string& path, const string& label) {
+        if (label.empty()) {
+            return path;
+        }
+        string tag;
+        for (char c : label) {
+            tag += isalnum(static_cast<unsigned char>(c)) || c == '-' || c == '_' ? c : '_';
+        }
+        filesystem::path file(path);
+        string name = file.filename().string();
+        size_t dot = name.find('.');
+        name = dot == string::npos ? name + "." + tag : name.substr(0, dot) + "." + tag + name.substr(dot);
+        return (file.parent_path() / name).string();
+    }
+
+    void open() const {
+        if (file_.is_open()) {
+            return;
+        }
+        if (resume_at_) {
+            filesystem::resize_file(path_, *resume_at_);
+            file_.open(path_, ios::binary | ios::app);
+        }
+        else {
+            file_.open(path_, ios::binary | ios::trunc);
+        }
+        if (!file_.is_open()) {
+            throw runtime_error{ "Could not open output file: " + path_ };
+        }
+    }
+
+    void writeCompressed(bool finish) {
+        const Zstd& zstd = Zstd::get();
+        Zstd::InBuffer input{ buffer_.data(), used_, 0 };
+        for (bool more = true; more;) {
+            Zstd::OutBuffer output{ zstd_output_.data(), zstd_output_.size(), 0 };
+            if (input.pos < input.size) {
+                zstd.check(zstd.compressStream(zstd_stream_, &output, &input));
+            }
+            else if (finish) {
+                more = zstd.check(zstd.endStream(zstd_stream_, &output)) != 0;
+            }
+            else {
+                more = false;
+            }
+            file_.write(zstd_output_.data(), output.pos);
+            written_ += output.pos;
+        }
+    }
+
+    void flushPlain() const {
+        open();
+        file_.write(buffer_.data(), used_);
+        written_ += used_;
+        used_ = 0;
+        if (!file_) {
+            throw runtime_error{ "Could not write output file: " + path_ };
+        }
+    }
+
+    void flush(bool finish) {
+        if (!compressed_) {
+            flushPlain();
+            return;
+        }
+        open();
+        writeCompressed(finish);
+        used_ = 0;
+        if (!file_) {
+            throw runtime_error{ "Could not write output file: " + path_ };
+        }
+    }
+
+    void append(const char* bytes, size_t size) {
+        while (size > 0) {
+            size_t take = min(size, kBufferSize - used_);
+            memcpy(buffer_.data() + used_, bytes, take);
+            used_ += take;
+            bytes += take;
+            size -= take;
+            if (used_ == kBufferSize) {
+                flush(false);
+            }
+        }
+    }
+
+public:
+    FileOutputObserver(const string& path, const string& label = "")
+        : prefix_(label.empty() ? "" : "[" + label + "] "), path_(labelledPath(path, label)), buffer_(kBufferSize) {
+        string name = path_;
+        compressed_ = name.ends_with(".zst");
+        if (compressed_) {
+            name.resize(name.size() - 4);
+            const Zstd& zstd = Zstd::get();
+            zstd_stream_ = zstd.createCStream();
+            zstd.check(zstd.initCStream(zstd_stream_, kZstdLevel));
+            zstd_output_.resize(zstd.cStreamOutSize());
+        }
+        binary_ = name.ends_with(".bin");
+        if (binary_) {
+            append(kBinaryNumbersMagic, sizeof(kBinaryNumbersMagic));
+        }
+    }
+    FileOutputObserver(const FileOutputObserver&) = delete;
+    FileOutputObserver& operator=(const FileOutputObserver&) = delete;
+    ~FileOutputObserver() override {
+        if (zstd_stream_) {
+            Zstd::get().freeCStream(zstd_stream_);
+        }
+    }
+    void on_number(int number) override {
+        on_batch(&number, 1);
+    }
+    void on_batch(const int* numbers, size_t count) override {
+        count_ += count;
+        if (binary_) {
+            append(reinterpret_cast<const char*>(numbers), count * sizeof(int));
+            return;
+        }
+        for (size_t i = 0; i < count; ++i) {
+            if (kBufferSize - used_ < 12) {
+                flush(false);
+            }
+            char* end = to_chars(buffer_.data() + used_, buffer_.data() + kBufferSize, numbers[i]).ptr;
+            *end++ = '\n';
+            used_ = static_cast<size_t>(end - buffer_.data());
+        }
+    }
+    void on_finished() override {
+        flush(true);
+        file_.close();
+        cout << prefix_ << "Wrote " << count_ << " filtered numbers to " << path_ << endl;
+    }
+    void save_state(ostream& out) const override {
+        if (compressed_) {
+            throw runtime_error{ "Compressed output cannot be checkpointed: " + path_ };
+        }
+        flushPlain();
+        file_.flush();
+        writeValue(out, written_);
+        writeValue(out, count_);
+    }
+    void load_state(istream& in) override {
+        if (compressed_ || file_.is_open()) {
+            throw runtime_error{ "Output cannot be resumed: " + path_ };
+        }
+        resume_at_ = readValue<uint64_t>(in);
+        written_ = *resume_at_;
+        count_ = readValue<uint64_t>(in);
+        used_ = 0;
+    }
+};
+
+// Bounded single-producer/single-consumer ring. Slots are reused in place, so a
+// slot holding a vector keeps its capacity and the steady state allocates
+// nothing. Blocking waits use C++20 atomic wait/notify on the positions.
+template <typename T>
+class SpscQueue {
+private:
+    vector<T> slots_;
+    size_t mask_;
+    alignas(64) atomic<size_t> head_{ 0 };
+    alignas(64) atomic<size_t> tail_{ 0 };
+
+public:
+    explicit SpscQueue(size_t capacity) {
+        size_t size = 1;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        slots_.resize(size);
+        mask_ = size - 1;
+    }
+    T* try_begin_push() {
+        size_t tail = tail_.load(memory_order_relaxed);
+        return tail - head_.load(memory_order_acquire) == slots_.size() ? nullptr : &slots_[tail & mask_];
+    }
+    T& begin_push() {
+        size_t tail = tail_.load(memory_order_relaxed);
+        for (size_t head = head_.load(memory_order_acquire); tail - head == slots_.size(); head = head_.load(memory_order_acquire)) {
+            head_.wait(head, memory_order_acquire);
+        }
+        return slots_[tail & mask_];
+    }
+    void end_push() {
+        tail_.fetch_add(1, memory_order_release);
+        tail_.notify_one();
+    }
+    T& begin_pop() {
+        size_t head = head_.load(memory_order_relaxed);
+        for (size_t tail = tail_.load(memory_order_acquire); head == tail; tail = tail_.load(memory_order_acquire)) {
+            tail_.wait(tail, memory_order_acquire);
+        }
+        return slots_[head & mask_];
+    }
+    void end_pop() {
+        head_.fetch_add(1, memory_order_release);
+        head_.notify_one();
+    }
+    void wait_empty() const {
+        size_t tail = tail_.load(memory_order_relaxed);
+        for (size_t head = head_.load(memory_order_acquire); head != tail; head = head_.load(memory_order_acquire)) {
+            head_.wait(head, memory_order_acquire);
+        }
+    }
+};
+
+// Runs the wrapped observer on its own thread. Batches are copied into a
+// bounded SPSC ring; when the ring is full the producer either blocks or drops
+// the batch, depending on the backpressure mode. An empty batch marks the end
+// of the stream, so on_finished is a join barrier: it returns only after the
+// wrapped observer has consumed everything and finished.
+class AsyncObserver : public INumberObserver {
+public:
+    enum class Backpressure { BLOCK, DROP };
+
+private:
+    unique_ptr<INumberObserver> inner_;
+    Backpressure backpressure_;
+    SpscQueue<vector<int>> queue_;
+    thread worker_;
+    uint64_t dropped_ = 0;
+    // Written by the worker only; error_ is read after the queue is drained.
+    atomic<bool> satisfied_{ false };
+    exception_ptr error_;
+
+    // After an exception the worker keeps draining the queue, so producers
+    // never block, and on_finished rethrows it.
+    void consume() {
+        for (;;) {
+            vector<int>& batch = queue_.begin_pop();
+            if (batch.empty()) {
+                queue_.end_pop();
+                return;
+            }
+            if (!error_) {
+                try {
+                    inner_->on_batch(batch.data(), batch.size());
+                    if (inner_->satisfied()) {
+                        satisfied_.store(true, memory_order_release);
+                    }
+                }
+                catch (...) {
+                    error_ = current_exception();
+                }
+            }
+            queue_.end_pop();
+        }
+    }
+    void stop() {
+        if (worker_.joinable()) {
+            queue_.begin_push().clear();
+            queue_.end_push();
+            worker_.join();
+        }
+    }
+
+public:
+    AsyncObserver(unique_ptr<INumberObserver> inner, Backpressure backpressure, size_t capacity = 64)
+        : inner_(move(inner)), backpressure_(backpressure), queue_(capacity) {
+        worker_ = thread(&AsyncObserver::consume, this);
+    }
+    ~AsyncObserver() override {
+        stop();
+    }
+    void on_number(int number) override {
+        on_batch(&number, 1);
+    }
+    void on_batch(const int* numbers, size_t count) override {
+        if (count == 0) {
+            return;
+        }
+        vector<int>* slot = backpressure_ == Backpressure::BLOCK ? &queue_.begin_push() : queue_.try_begin_push();
+        if (!slot) {
+            dropped_ += count;
+            return;
+        }
+        slot->assign(numbers, numbers + count);
+        queue_.end_push();
+    }
+    // Reported by the worker after each batch rather than by waiting for the
+    // queue to drain, which would stall every delivery; a satisfied observer
+    // stays satisfied, so at worst a few more batches are queued.
+    bool satisfied() const override {
+        return satisfied_.load(memory_order_acquire);
+    }
+    void on_snapshot() override {
+        queue_.wait_empty();
+        if (!error_) {
+            inner_->on_snapshot();
+        }
+    }
+    // Waits until the worker has consumed everything queued, so the wrapped
+    // observer is quiescent while its state is read or replaced.
+    void save_state(ostream& out) const override {
+        queue_.wait_empty();
+        inner_->save_state(out);
+    }
+    void load_state(istream& in) override {
+        queue_.wait_empty();
+        inner_->load_state(in);
+    }
+    void on_finished() override {
+        stop();
+        if (error_) {
+            rethrow_exception(error_);
+        }
+        inner_->on_finished();
+        if (dropped_ > 0) {
+            Logger::instance().log(LogLevel::WARNING, "Warning: Async observer dropped " + to_string(dropped_) + " numbers under backpressure.");
+        }
+    }
+};
+
+int parseDistinctMode(const string& arg) {
+    if (arg.empty() || arg == "exact") {
+        return 0;
+    }
+    if (arg.starts_with("hll")) {
+        return arg.size() == 3 ? 14 : toIntArg("DISTINCT", parseFilterArgs("DISTINCT", arg.substr(3), 1)[0]);
+    }
+    throw invalid_argument{ "Invalid argument for DISTINCT observer: " + arg };
+}
+
+size_t parseObserverSize(const string& observerName, const string& arg, size_t defaultValue) {
+    if (arg.empty()) {
+        return defaultValue;
+    }
+    int value = toIntArg(observerName, parseFilterArgs(observerName, arg, 1)[0]);
+    if (value <= 0) {
+        throw invalid_argument{ observerName + " observer requires a positive size: " + arg };
+    }
+    return static_cast<size_t>(value);
+}
+
+class ExistsObserver : public INumberObserver {
+private:
+    string prefix_;
+    bool found_ = false;
+    int first_ = 0;
+public:
+    ExistsObserver(const string& label = "") : prefix_(label.empty() ? "" : "[" + label + "] ") {}
+    void on_number(int number) override {
+        if (!found_) {
+            found_ = true;
+            first_ = number;
+        }
+    }
+    bool satisfied() const override {
+        return found_;
+    }
+    void save_state(ostream& out) const override {
+        writeValue(out, found_);
+        writeValue(out, first_);
+    }
+    void load_state(istream& in) override {
+        found_ = readValue<bool>(in);
+        first_ = readValue<int>(in);
+    }
+    void on_finished() override {
+        if (found_) {
+            cout << prefix_ << "A matching number exists: " << first_ << endl;
+        }
+        else {
+            cout << prefix_ << "No matching number found." << endl;
+        }
+    }
+};
+
+class ObserverFactory {
+private:
+    using ObserverCreator = function<unique_ptr<INumberObserver>(const string& arg, const string& label)>;
+    map<string, ObserverCreator> creators_;
+
+public:
+    ObserverFactory() {
+        registerObserver("PRINT", [](const string&, const string& label) { return make_unique<PrintObserver>(label); });
+        registerObserver("COUNT", [](const string&, const string& label) { return make_unique<CountObserver>(label); });
+        registerObserver("EXISTS", [](const string&, const string& label) { return make_unique<ExistsObserver>(label); });
+        registerObserver("TOPK", [](const string& arg, const string& label) {
+            return make_unique<TopKObserver>(parseObserverSize("TOPK", arg, 10), label);
+            });
+        registerObserver("HEAVY", [](const string& arg, const string& label) {
+            return make_unique<HeavyHittersObserver>(parseObserverSize("HEAVY", arg, 10), label);
+            });
+        registerObserver("DISTINCT", [](const string& arg, const string& label) {
+            return make_unique<DistinctObserver>(parseDistinctMode(arg), label);
+            });
+        registerObserver("TUMBLING", [](const string& arg, const string& label) {
+            return make_unique<TumblingWindowObserver>(parseObserverSize("TUMBLING", arg, 1000), label);
+            });
+        registerObserver("SLIDING", [](const string& arg, const string& label) {
+            size_t comma = arg.find(',');
+            size_t size = parseObserverSize("SLIDING", arg.substr(0, comma), 1000);
+            size_t step = comma == string::npos ? 1 : parseObserverSize("SLIDING", arg.substr(comma + 1), 1);
+            return make_unique<SlidingWindowObserver>(size, step, label);
+            });
+        registerObserver("SORTED", [](const string& arg, const string& label) {
+            return make_unique<SortedOutputObserver>(parseObserverSize("SORTED", arg, 1024) << 20, label);
+            });
+        registerObserver("WRITE", [](const string& arg, const string& label) {
+            if (arg.empty()) {
+                throw invalid_argument{ "WRITE needs an output file, e.g. WRITE:matches.txt" };
+            }
+            return make_unique<FileOutputObserver>(arg, label);
+            });
+    }
+
+    void registerObserver(const string& observerName, ObserverCreator creator) {
+        creators_[observerName] = creator;
+    }
+
+    unique_ptr<INumberObserver> createObserver(const string& observerType, const string& observerArg = "", const string& label = "") const {
+        if (auto it = creators_.find(observerType); it != creators_.end()) {
+            return it->second(observerArg, label);
+        }
+        throw invalid_argument{ "Unknown observer type: " + observerType };
+    }
+
+    // NAME[:arg][@async|@async-drop]
+    unique_ptr<INumberObserver> createObserverFromSpec(const string& spec, const string& label = "") const {
+        size_t at = spec.rfind('@');
+        auto [observerType, observerArg] = parseFilterSpec(spec.substr(0, at));
+        unique_ptr<INumberObserver> observer = createObserver(observerType, observerArg, label);
+        if (at == string::npos) {
+            return observer;
+        }
+        string mode = spec.substr(at + 1);
+        if (mode == "async") {
+            return make_unique<AsyncObserver>(move(observer), AsyncObserver::Backpressure::BLOCK);
+        }
+        if (mode == "async-drop") {
+            return make_unique<AsyncObserver>(move(observer), AsyncObserver::Backpressure::DROP);
+        }
+        throw invalid_argument{ "Unknown observer mode: " + mode };
+    }
+};
+
+class PluginFilter : public INumberFilter {
+private:
+    NumberPluginFilter impl_;
+public:
+    explicit PluginFilter(const NumberPluginFilter& impl) : impl_(impl) {}
+    ~PluginFilter() override {
+        if (impl_.destroy) {
+            impl_.destroy(impl_.state);
+        }
+    }
+    PluginFilter(const PluginFilter&) = delete;
+    PluginFilter& operator=(const PluginFilter&) = delete;
+
+    bool keep(int number) const override {
+        return impl_.keep(impl_.state, number) != 0;
+    }
+    void keep_batch(const int* numbers, size_t count, unsigned char* selected) const override {
+        if (impl_.keep_batch) {
+            impl_.keep_batch(impl_.state, numbers, count, selected);
+        }
+        else {
+            INumberFilter::keep_batch(numbers, count, selected);
+        }
+    }
+};
+
+class PluginObserver : public INumberObserver {
+private:
+    NumberPluginObserver impl_;
+public:
+    explicit PluginObserver(const NumberPluginObserver& impl) : impl_(impl) {}
+    ~PluginObserver() override {
+        if (impl_.destroy) {
+            impl_.destroy(impl_.state);
+        }
+    }
+    PluginObserver(const PluginObserver&) = delete;
+    PluginObserver& operator=(const PluginObserver&) = delete;
+
+    void on_number(int number) override {
+        impl_.on_batch(impl_.state, &number, 1);
+    }
+    void on_batch(const int* numbers, size_t count) override {
+        impl_.on_batch(impl_.state, numbers, count);
+    }
+    void on_finished() override {
+        if (impl_.on_finished) {
+            impl_.on_finished(impl_.state);
+        }
+    }
+    void save_state(ostream& /*out*/) const override {
+        throw runtime_error{ "Plugin observers cannot be checkpointed" };
+    }
+};
+
+// Keeps every loaded plugin library mapped until destruction; declare it before
+// any filter or observer that a plugin may have created.
+class PluginLibraries {
+private:
+    struct Host {
+        FilterFactory& filters;
+        ObserverFactory& observers;
+    };
+    vector<void*> handles_;
+
+    static void registerFilter(void* host, const char* name, NumberPluginFilterCreate create) {
+        static_cast<Host*>(host)->filters.registerFilter(name, [create, plugin_name = string(name)](const string& arg) {
+            NumberPluginFilter impl{};
+            if (create(arg.c_str(), &impl) != 0 || !impl.keep) {
+                throw invalid_argument{ "Plugin filter " + plugin_name + " rejected argument: " + arg };
+            }
+            return make_unique<PluginFilter>(impl);
+            });
+    }
+
+    static void registerObserver(void* host, const char* name, NumberPluginObserverCreate create) {
+        static_cast<Host*>(host)->observers.registerObserver(name, [create, plugin_name = string(name)](const string& arg, const string& label) {
+            NumberPluginObserver impl{};
+            if (create(arg.c_str(), label.c_str(), &impl) != 0 || !impl.on_batch) {
+                throw invalid_argument{ "Plugin observer " + plugin_name + " rejected argument: " + arg };
+            }
+            return make_unique<PluginObserver>(impl);
+            });
+    }
+
+public:
+    PluginLibraries() = default;
+    PluginLibraries(const PluginLibraries&) = delete;
+    PluginLibraries& operator=(const PluginLibraries&) = delete;
+    ~PluginLibraries() {
+        for (void* handle : handles_) {
+#if defined(_WIN32)
+            FreeLibrary(static_cast<HMODULE>(handle));
+#else
+            dlclose(handle);
+#endif
+        }
+    }
+
+    void load(const string& path, FilterFactory& filters, ObserverFactory& observers) {
+#if defined(_WIN32)
+        HMODULE handle = LoadLibraryA(path.c_str());
+        if (!handle) {
+            throw runtime_error{ "Could not load plugin: " + path };
+        }
+        auto entry = reinterpret_cast<NumberPluginEntry>(GetProcAddress(handle, NUMBER_PLUGIN_ENTRY_NAME));
+#else
+        void* handle = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+        if (!handle) {
+            throw runtime_error{ "Could not load plugin: " + path + " (" + dlerror() + ")" };
+        }
+        auto entry = reinterpret_cast<NumberPluginEntry>(dlsym(handle, NUMBER_PLUGIN_ENTRY_NAME));
+#endif
+        handles_.push_back(handle);
+        if (!entry) {
+            throw runtime_error{ "Plugin does not export " NUMBER_PLUGIN_ENTRY_NAME ": " + path };
+        }
+        Host host{ filters, observers };
+        NumberPluginRegistry registry{ &host, &PluginLibraries::registerFilter, &PluginLibraries::registerObserver };
+        entry(&registry);
+    }
+};
+
+struct FilterStage {
+    const INumberFilter& filter;
+};
+
+struct TakeStage {
+    uint64_t limit;
+};
+
+inline FilterStage filter(const INumberFilter& numberFilter) {
+    return FilterStage{ numberFilter };
+}
+
+inline TakeStage take(uint64_t limit) {
+    return TakeStage{ limit };
+}
+
+// reader.stream(file) | filter(f) | take(n): each stage pulls batches from the
+// one before it, so stopping early also stops the reading.
+NumberBatches operator|(NumberBatches source, FilterStage stage) {
+    vector<unsigned char> selected;
+    vector<int> matches;
+    for (span<const int> batch : source) {
+        selected.resize(batch.size());
+        matches.resize(batch.size());
+        stage.filter.keep_batch(batch.data(), batch.size(), selected.data());
+        size_t matched = 0;
+        for (size_t i = 0; i < batch.size(); ++i) {
+            matches[matched] = batch[i];
+            matched += selected[i];
+        }
+        if (matched > 0) {
+            co_yield span<const int>(matches.data(), matched);
+        }
+    }
+}
+
+NumberBatches operator|(NumberBatches source, TakeStage stage) {
+    uint64_t remaining = stage.limit;
+    if (remaining == 0) {
+        co_return;
+    }
+    for (span<const int> batch : source) {
+        size_t count = static_cast<size_t>(min<uint64_t>(batch.size(), remaining));
+        co_yield batch.first(count);
+        remaining -= count;
+        if (remaining == 0) {
+            co_return;
+        }
+    }
+}
+
+// CPUs grouped by NUMA node, read from sysfs on Linux. Elsewhere, or when
+// sysfs is unavailable, the machine is treated as a single node.
+struct NumaTopology {
+    vector<vector<unsigned>> nodes;
+
+    // Parses the kernel's cpulist format, e.g. "0-3,8-11".
+    static vector<unsigned> parseCpuList(const string& list) {
+        vector<unsigned> cpus;
+        stringstream ss(list);
+        string range;
+        while (getline(ss, range, ',')) {
+            if (range.empty() || range == "\n") {
+                continue;
+            }
+            size_t dash = range.find('-');
+            unsigned first = static_cast<unsigned>(stoul(range.substr(0, dash)));
+            unsigned last = dash == string::npos ? first : static_cast<unsigned>(stoul(range.substr(dash + 1)));
+            for (unsigned cpu = first; cpu <= last; ++cpu) {
+                cpus.push_back(cpu);
+            }
+        }
+        return cpus;
+    }
+
+    static NumaTopology detect() {
+        NumaTopology topology;
+#if defined(__linux__)
+        for (unsigned node = 0;; ++node) {
+            ifstream file("/sys/devices/system/node/node" + to_string(node) + "/cpulist");
+            string list;
+            if (!file.is_open() || !getline(file, list)) {
+                break;
+            }
+            vector<unsigned> cpus = parseCpuList(list);
+            if (!cpus.empty()) {
+                topology.nodes.push_back(move(cpus));
+            }
+        }
+#endif
+        if (topology.nodes.empty()) {
+            vector<unsigned> cpus(max(1u, thread::hardware_concurrency()));
+            for (unsigned cpu = 0; cpu < cpus.size(); ++cpu) {
+                cpus[cpu] = cpu;
+            }
+            topology.nodes.push_back(move(cpus));
+        }
+        return topology;
+    }
+
+    // Splits the detected CPUs into `count` equal pseudo-nodes, so node-aware
+    // scheduling can be exercised on single-node machines.
+    static NumaTopology emulate(size_t count) {
+        vector<unsigned> cpus;
+        for (const vector<unsigned>& node : detect().nodes) {
+            cpus.insert(cpus.end(), node.begin(), node.end());
+        }
+        count = clamp<size_t>(count, 1, cpus.size());
+        NumaTopology topology;
+        for (size_t n = 0; n < count; ++n) {
+            topology.nodes.emplace_back(cpus.begin() + cpus.size() * n / count, cpus.begin() + cpus.size() * (n + 1) / count);
+        }
+        return topology;
+    }
+
+    size_t size() const {
+        return nodes.size();
+    }
+};
+
+// Best effort: a worker that cannot be pinned simply runs unpinned.
+void pinToCpus(thread& worker, const vector<unsigned>& cpus) {
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (unsigned cpu : cpus) {
+        if (cpu < CPU_SETSIZE) {
+            CPU_SET(cpu, &set);
+        }
+    }
+    pthread_setaffinity_np(worker.native_handle(), sizeof(set), &set);
+#endif
+}
+
+// Prints how far a run has got to stderr from its own timer thread. The
+// processor publishes progress with relaxed stores once per block (it is the
+// only writer), so the hot loop never locks or waits for the reporter.
+class ProgressReporter {
+private:
+    atomic<uint64_t> bytes_;
+    atomic<uint64_t> numbers_{ 0 };
+    uint64_t start_bytes_;
+    uint64_t total_bytes_;
+    chrono::steady_clock::time_point started_ = chrono::steady_clock::now();
+    mutex mutex_;
+    condition_variable_any wake_;
+    jthread thread_;
+
+    static string formatBytes(double bytes) {
+        const char* units[] = { "B", "KiB", "MiB", "GiB", "TiB" };
+        size_t unit = 0;
+        for (; bytes >= 1024 && unit + 1 < size(units); ++unit) {
+            bytes /= 1024;
+        }
+        ostringstream out;
+        out << fixed << setprecision(unit == 0 ? 0 : 1) << bytes << ' ' << units[unit];
+        return out.str();
+    }
+
+    static string formatDuration(double seconds) {
+        uint64_t total = static_cast<uint64_t>(seconds + 0.5);
+        ostringstream out;
+        out << total / 3600 << ':' << setfill('0') << setw(2) << total / 60 % 60 << ':' << setw(2) << total % 60;
+        return out.str();
+    }
+
+    void report(bool final) {
+        double elapsed = chrono::duration<double>(chrono::steady_clock::now() - started_).count();
+        uint64_t bytes = bytes_.load(memory_order_relaxed);
+        uint64_t numbers = numbers_.load(memory_order_relaxed);
+        double rate = elapsed > 0 ? (bytes - start_bytes_) / elapsed : 0;
+        ostringstream line;
+        line << "Progress: ";
+        if (bytes > 0) {
+            line << formatBytes(static_cast<double>(bytes));
+            if (total_bytes_ > 0) {
+                line << " of " << formatBytes(static_cast<double>(total_bytes_)) << " ("
+                    << fixed << setprecision(1) << 100.0 * min(bytes, total_bytes_) / total_bytes_ << "%)";
+            }
+            line << ", " << formatBytes(rate) << "/s, ";
+        }
+        line << numbers << " numbers";
+        if (final) {
+            line << " in " << formatDuration(elapsed);
+        }
+        else if (total_bytes_ > bytes && rate > 0) {
+            line << ", ETA " << formatDuration((total_bytes_ - bytes) / rate);
+        }
+        cerr << line.str() + '\n' << flush;
+    }
+
+public:
+    // `total_bytes` of zero means the input size is unknown, e.g. for a
+    // followed or compressed file, and no percentage or ETA is shown.
+    ProgressReporter(chrono::milliseconds interval, uint64_t start_bytes, uint64_t total_bytes)
+        : bytes_(start_bytes), start_bytes_(start_bytes), total_bytes_(total_bytes),
+        thread_([this, interval](stop_token stop) {
+            unique_lock lock(mutex_);
+            while (!stop.stop_requested()) {
+                wake_.wait_for(lock, stop, interval, [] { return false; });
+                if (!stop.stop_requested()) {
+                    report(false);
+                }
+            }
+        }) {
+    }
+    ProgressReporter(const ProgressReporter&) = delete;
+    ProgressReporter& operator=(const ProgressReporter&) = delete;
+
+    void set_bytes(uint64_t bytes) {
+        bytes_.store(bytes, memory_order_relaxed);
+    }
+    void add_numbers(uint64_t count) {
+        numbers_.store(numbers_.load(memory_order_relaxed) + count, memory_order_relaxed);
+    }
+    void finish() {
+        thread_.request_stop();
+        thread_.join();
+        report(true);
+    }
+};
+
+struct Query {
+    INumberFilter& filter;
+    vector<INumberObserver*> observers;
+    uint64_t limit = UINT64_MAX;
+    // The command-line specs, recorded in checkpoints so that a run with
+    // different filters or observers does not resume another run's state.
+    string filter_spec;
+    vector<string> observer_specs;
+};
+
+class NumberProcessor {
+private:
+    static constexpr size_t kBlockSize = 4096;
+
+    // A block whose filtering threw is still marked ready, carrying the error,
+    // so the delivering thread never waits on it forever.
+    struct BlockResult {
+        atomic<bool> ready{ false };
+        vector<vector<int>> matches;
+        exception_ptr error;
+    };
+
+    // One slot of the staged pipeline's ring. `stamp` is sequence * 4 + phase:
+    // the slot is free for that sequence (0), or holds its raw input (1), its
+    // parsed numbers (2) or its per-query matches (3). The buffers are reused
+    // by every sequence that passes through the slot.
+    struct PipelineSlot {
+        atomic<uint64_t> stamp{ 0 };
+        string raw;
+        bool binary = false;
+        optional<uint64_t> end;
+        vector<int> numbers;
+        vector<vector<int>> matches;
+    };
+
+    INumberReader& reader_;
+    vector<Query> queries_;
+    unsigned threads_ = 1;
+    unsigned parsers_ = 0;
+    NumaTopology topology_;
+    chrono::milliseconds snapshot_interval_{ 0 };
+    chrono::milliseconds progress_interval_{ 0 };
+    unique_ptr<ProgressReporter> progress_;
+    stop_source stop_;
+    vector<uint64_t> remaining_;
+    vector<char> active_;
+    size_t active_count_ = 0;
+    string checkpoint_path_;
+    chrono::milliseconds checkpoint_interval_{ 0 };
+    bool keep_checkpoint_ = false;
+    chrono::steady_clock::time_point next_snapshot_;
+    chrono::steady_clock::time_point next_checkpoint_;
+
+public:
+    NumberProcessor(INumberReader& reader, INumberFilter& filter, const vector<INumberObserver*>& observers)
+        : reader_(reader), queries_{ Query{ filter, observers, UINT64_MAX, "", {} } } {
+    }
+
+    NumberProcessor(INumberReader& reader, const vector<Query>& queries)
+        : reader_(reader), queries_(queries) {
+    }
+
+    // With more than one thread, blocks are filtered by up to this many tasks
+    // on the shared pool while the calling thread delivers finished blocks to
+    // the observers in order.
+    void set_threads(unsigned threads) {
+        threads_ = max(1u, threads);
+    }
+
+    // With more than one node, each batch is split into one contiguous range of
+    // blocks per node, the shared pool's workers are pinned to the nodes in
+    // turn, and each filter task drains the range of its worker's node before
+    // stealing from the others. Per-block results are allocated by the worker
+    // that fills them, so they are first-touched on that worker's node. The
+    // input itself is not placed: the batch is read and parsed by the calling
+    // thread, so its pages sit on that thread's node and the other nodes read
+    // it remotely. A single node is the plain shared-cursor schedule.
+    void set_topology(const NumaTopology& topology) {
+        topology_ = topology;
+        if (topology_.size() > 1) {
+            ThreadPool& pool = ThreadPool::shared();
+            for (size_t w = 0; w < pool.size(); ++w) {
+                pinToCpus(pool.worker(w), topology_.nodes[w % topology_.size()]);
+            }
+        }
+    }
+
+    // With a nonzero count, readers that can hand out unparsed input run as a
+    // staged pipeline instead: an I/O thread, this many parser threads, a
+    // filter thread, and the calling thread delivering to the observers.
+    void set_pipeline(unsigned parsers) {
+        parsers_ = parsers;
+    }
+
+    // Calls on_snapshot on every observer at most this often; zero disables it.
+    void set_snapshot_interval(chrono::milliseconds interval) {
+        snapshot_interval_ = interval;
+    }
+
+    // Reports progress to stderr at this interval; zero disables it.
+    void set_progress_interval(chrono::milliseconds interval) {
+        progress_interval_ = interval;
+    }
+
+    // Periodically saves the read position and all observer state to `path`,
+    // and resumes from it if the file exists when run() starts. The file is
+    // removed once a run completes, unless `keep_at_end` asks for a final save
+    // instead (for inputs that are never really complete, like --follow).
+    void set_checkpoint(const string& path, chrono::milliseconds interval, bool keep_at_end = false) {
+        checkpoint_path_ = path;
+        checkpoint_interval_ = interval;
+        keep_checkpoint_ = keep_at_end;
+    }
+
+    // May be called from any thread; the run stops at the next block boundary.
+    void request_stop() {
+        stop_.request_stop();
+    }
+
+    // All queries share one read/parse of the file; each block is filtered by every
+    // query while it is still in cache, then the matches are dispatched per query.
+    // Reading stops as soon as every query has reached its limit or has only
+    // satisfied observers, or a stop is requested. Returns false if processing
+    // failed; the error has been logged.
+    bool run(const string& filename) {
+        try {
+            remaining_.clear();
+            active_.assign(queries_.size(), 0);
+            active_count_ = 0;
+            for (size_t q = 0; q < queries_.size(); ++q) {
+                remaining_.push_back(queries_[q].limit);
+                if (queries_[q].limit > 0) {
+                    active_[q] = 1;
+                    ++active_count_;
+                }
+            }
+            uint64_t start = 0;
+            if (!checkpoint_path_.empty() && filesystem::exists(checkpoint_path_)) {
+                start = loadCheckpoint(filename);
+                Logger::instance().log(LogLevel::INFO, "Resuming from checkpoint " + checkpoint_path_ + " at byte " + to_string(start));
+            }
+            if (active_count_ == 0) {
+                stop_.request_stop();
+            }
+            if (progress_interval_.count() > 0) {
+                progress_ = make_unique<ProgressReporter>(progress_interval_, start, reader_.input_size(filename).value_or(0));
+            }
+            next_snapshot_ = chrono::steady_clock::now() + snapshot_interval_;
+            next_checkpoint_ = chrono::steady_clock::now() + checkpoint_interval_;
+            optional<uint64_t> position = parsers_ > 0 && reader_.has_chunks() ? runPipeline(filename, start) : runStream(filename, start);
+            if (!checkpoint_path_.empty() && keep_checkpoint_) {
+                saveCheckpoint(filename, position);
+            }
+            if (progress_) {
+                progress_->finish();
+                progress_.reset();
+            }
+            notifyFinished();
+            if (!checkpoint_path_.empty() && !keep_checkpoint_) {
+                filesystem::remove(checkpoint_path_);
+            }
+            return true;
+        }
+        catch (const runtime_error& e) {
+            progress_.reset();
+            Logger::instance().log(LogLevel::ERROR, string("Error during processing: ") + e.what());
+            return false;
+        }
+    }
+
+private:
+    static constexpr char kCheckpointMagic[8] = { 'N', 'P', 'C', 'K', 'P', 'T', '0', '3' };
+
+    // Recorded in checkpoints so a file replaced or rewritten under the same
+    // name is not resumed at a stale offset.
+    struct InputIdentity {
+        uint64_t inode = 0;
+        uint64_t size = 0;
+        int64_t modified = 0;
+    };
+
+    static InputIdentity identify(const string& filename) {
+        InputIdentity identity;
+#if defined(__unix__) || defined(__APPLE__)
+        struct stat info;
+        if (::stat(filename.c_str(), &info) == 0) {
+            identity.inode = static_cast<uint64_t>(info.st_ino);
+            identity.size = static_cast<uint64_t>(info.st_size);
+#if defined(__APPLE__)
+            identity.modified = static_cast<int64_t>(info.st_mtimespec.tv_sec) * 1000000000 + info.st_mtimespec.tv_nsec;
+#else
+            identity.modified = static_cast<int64_t>(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec;
+#endif
+        }
+#else
+        error_code error;
+        uintmax_t size = filesystem::file_size(filename, error);
+        identity.size = error ? 0 : static_cast<uint64_t>(size);
+        auto modified = filesystem::last_write_time(filename, error);
+        identity.modified = error ? 0 : static_cast<int64_t>(modified.time_since_epoch().count());
+#endif
+        return identity;
+    }
+
+    // Returns the reader position after the last batch processed.
+    optional<uint64_t> runStream(const string& filename, uint64_t start) {
+        vector<unsigned char> selected(kBlockSize);
+        vector<int> matches(kBlockSize);
+        for (span<const int> numbers : reader_.stream(filename, start)) {
+            if (threads_ > 1) {
+                processParallel(numbers);
+            }
+            else {
+                for (size_t begin = 0; begin < numbers.size() && !stop_.stop_requested(); begin += kBlockSize) {
+                    size_t count = min(kBlockSize, numbers.size() - begin);
+                    processBlock(numbers.data() + begin, count, selected, matches);
+                    if (progress_) {
+                        progress_->add_numbers(count);
+                    }
+                }
+            }
+            afterBatch(filename, reader_.position());
+            // Checked here rather than at the top of the loop: advancing the
+            // generator would read and parse another chunk first.
+            if (stop_.stop_requested()) {
+                break;
+            }
+        }
+        return reader_.position();
+    }
+
+    static void waitForStamp(const atomic<uint64_t>& stamp, uint64_t expected) {
+        for (uint64_t seen = stamp.load(memory_order_acquire); seen != expected; seen = stamp.load(memory_order_acquire)) {
+            stamp.wait(seen, memory_order_acquire);
+        }
+    }
+
+    static void setStamp(atomic<uint64_t>& stamp, uint64_t value) {
+        stamp.store(value, memory_order_release);
+        stamp.notify_all();
+    }
+
+    // `published` holds twice the number of chunks the I/O thread has placed
+    // in the ring, plus one once it has finished. Returns false when the input
+    // ended before `sequence`.
+    static bool waitForSequence(const atomic<uint64_t>& published, uint64_t sequence) {
+        for (uint64_t seen = published.load(memory_order_acquire);; seen = published.load(memory_order_acquire)) {
+            if (sequence < seen / 2) {
+                return true;
+            }
+            if (seen & 1) {
+                return false;
+            }
+            published.wait(seen, memory_order_acquire);
+        }
+    }
+
+    // The staged alternative to processParallel for input that cannot be split
+    // up front. The I/O thread cuts the input into raw chunks, parser threads
+    // turn chunks into numbers in whatever order they finish, the filter
+    // thread runs every query over them in input order, and this thread
+    // delivers the matches. The stages pass ring slots to each other through
+    // their stamps, so nothing is locked or allocated per chunk once the
+    // buffers have grown. After a stop every stage keeps handing the remaining
+    // slots on without doing any work, so all threads drain out.
+    optional<uint64_t> runPipeline(const string& filename, uint64_t start) {
+        size_t ring_size = 2 * static_cast<size_t>(parsers_) + 2;
+        vector<PipelineSlot> slots(ring_size);
+        for (size_t i = 0; i < ring_size; ++i) {
+            slots[i].stamp = i * 4;
+        }
+        atomic<uint64_t> published{ 0 };
+        atomic<uint64_t> next_parse{ 0 };
+        exception_ptr read_error;
+        exception_ptr deliver_error;
+        // The first error from a parser or the filter stage. The failing stage
+        // stops the run but keeps passing slots on, so the others drain.
+        mutex stage_error_mutex;
+        exception_ptr stage_error;
+        auto fail = [&](exception_ptr error) {
+            {
+                lock_guard<mutex> lock(stage_error_mutex);
+                if (!stage_error) {
+                    stage_error = error;
+                }
+            }
+            stop_.request_stop();
+        };
+        stop_token stop = stop_.get_token();
+        vector<char> active = active_;
+        optional<uint64_t> position = start;
+
+        vector<jthread> threads;
+        threads.emplace_back([&] {
+            uint64_t sequence = 0;
+            try {
+                for (const InputChunk& chunk : reader_.chunks(filename, start)) {
+                    if (stop.stop_requested()) {
+                        break;
+                    }
+                    PipelineSlot& slot = slots[sequence % ring_size];
+                    waitForStamp(slot.stamp, sequence * 4);
+                    slot.raw.assign(chunk.bytes);
+                    slot.binary = chunk.binary;
+                    slot.end = chunk.end;
+                    setStamp(slot.stamp, sequence * 4 + 1);
+                    ++sequence;
+                    published.store(sequence * 2, memory_order_release);
+                    published.notify_all();
+                }
+            }
+            catch (...) {
+                read_error = current_exception();
+            }
+            published.store(sequence * 2 + 1, memory_order_release);
+            published.notify_all();
+            });
+        for (unsigned p = 0; p < parsers_; ++p) {
+            threads.emplace_back([&] {
+                StructuralParser parser;
+                for (uint64_t sequence = next_parse.fetch_add(1); waitForSequence(published, sequence); sequence = next_parse.fetch_add(1)) {
+                    PipelineSlot& slot = slots[sequence % ring_size];
+                    slot.numbers.clear();
+                    if (!stop.stop_requested()) {
+                        try {
+                            parseInputChunk(InputChunk{ slot.raw, slot.binary, slot.end }, parser, slot.numbers);
+                        }
+                        catch (...) {
+                            fail(current_exception());
+                        }
+                    }
+                    setStamp(slot.stamp, sequence * 4 + 2);
+                }
+                });
+        }
+        threads.emplace_back([&] {
+            vector<unsigned char> selected(kBlockSize);
+            for (uint64_t sequence = 0; waitForSequence(published, sequence); ++sequence) {
+                PipelineSlot& slot = slots[sequence % ring_size];
+                waitForStamp(slot.stamp, sequence * 4 + 2);
+                slot.matches.resize(queries_.size());
+                try {
+                    for (size_t q = 0; q < queries_.size(); ++q) {
+                        vector<int>& matches = slot.matches[q];
+                        matches.clear();
+                        for (size_t begin = 0; active[q] && begin < slot.numbers.size() && !stop.stop_requested(); begin += kBlockSize) {
+                            const int* block = slot.numbers.data() + begin;
+                            size_t count = min(kBlockSize, slot.numbers.size() - begin);
+                            queries_[q].filter.keep_batch(block, count, selected.data());
+                            size_t used = matches.size();
+                            matches.resize(used + count);
+                            matches.resize(used + compact(block, selected.data(), count, matches.data() + used));
+                        }
+                    }
+                }
+                catch (...) {
+                    fail(current_exception());
+                }
+                setStamp(slot.stamp, sequence * 4 + 3);
+            }
+            });
+
+        for (uint64_t sequence = 0; waitForSequence(published, sequence); ++sequence) {
+            PipelineSlot& slot = slots[sequence % ring_size];
+            waitForStamp(slot.stamp, sequence * 4 + 3);
+            try {
+                if (!stop.stop_requested()) {
+                    for (size_t q = 0; q < slot.matches.size(); ++q) {
+                        deliver(q, slot.matches[q].data(), slot.matches[q].size());
+                    }
+                    if (progress_) {
+                        progress_->add_numbers(slot.numbers.size());
+                    }
+                    position = slot.end;
+                    afterBatch(filename, position);
+                }
+            }
+            catch (...) {
+                deliver_error = current_exception();
+                stop_.request_stop();
+            }
+            setStamp(slot.stamp, (sequence + ring_size) * 4);
+        }
+        threads.clear();
+        if (read_error) {
+            rethrow_exception(read_error);
+        }
+        if (stage_error) {
+            rethrow_exception(stage_error);
+        }
+        if (deliver_error) {
+            rethrow_exception(deliver_error);
+        }
+        return position;
+    }
+
+    void afterBatch(const string& filename, optional<uint64_t> position) {
+        if (progress_) {
+            progress_->set_bytes(position.value_or(0));
+        }
+        auto now = chrono::steady_clock::now();
+        if (snapshot_interval_.count() > 0 && now >= next_snapshot_) {
+            notifySnapshot();
+            next_snapshot_ = chrono::steady_clock::now() + snapshot_interval_;
+        }
+        if (!checkpoint_path_.empty() && !stop_.stop_requested() && now >= next_checkpoint_) {
+            saveCheckpoint(filename, position);
+            next_checkpoint_ = chrono::steady_clock::now() + checkpoint_interval_;
+        }
+    }
+
+    // Written to a temporary file and renamed into place, so an interrupted
+    // save never replaces a good checkpoint with a partial one.
+    void saveCheckpoint(const string& filename, optional<uint64_t> position) {
+        if (!position) {
+            Logger::instance().log(LogLevel::WARNING, "Warning: the input reader cannot resume, checkpoints disabled");
+            checkpoint_path_.clear();
+            return;
+        }
+        string temporary = checkpoint_path_ + ".tmp";
+        try {
+            ofstream out(temporary, ios::binary | ios::trunc);
+            out.write(kCheckpointMagic, sizeof(kCheckpointMagic));
+            writeVector(out, vector<char>(filename.begin(), filename.end()));
+            InputIdentity identity = identify(filename);
+            writeValue(out, identity.inode);
+            writeValue(out, identity.size);
+            writeValue(out, identity.modified);
+            writeValue(out, *position);
+            writeValue<uint64_t>(out, queries_.size());
+            for (size_t q = 0; q < queries_.size(); ++q) {
+                writeValue(out, remaining_[q]);
+                writeValue(out, active_[q]);
+                writeVector(out, vector<char>(queries_[q].filter_spec.begin(), queries_[q].filter_spec.end()));
+                writeValue<uint64_t>(out, queries_[q].observers.size());
+                for (size_t o = 0; o < queries_[q].observers.size(); ++o) {
+                    const string spec = o < queries_[q].observer_specs.size() ? queries_[q].observer_specs[o] : "";
+                    writeVector(out, vector<char>(spec.begin(), spec.end()));
+                    queries_[q].observers[o]->save_state(out);
+                }
+            }
+            out.close();
+            if (!out) {
+                throw runtime_error{ "Could not write checkpoint: " + temporary };
+            }
+            filesystem::rename(temporary, checkpoint_path_);
+        }
+        catch (const exception& e) {
+            Logger::instance().log(LogLevel::WARNING, string("Warning: ") + e.what() + ", checkpoints disabled");
+            filesystem::remove(temporary);
+            checkpoint_path_.clear();
+        }
+    }
+
+    uint64_t loadCheckpoint(const string& filename) {
+        ifstream in(checkpoint_path_, ios::binary);
+        char magic[sizeof(kCheckpointMagic)];
+        if (!in.read(magic, sizeof(magic)) || !equal(begin(magic), end(magic), begin(kCheckpointMagic))) {
+            throw runtime_error{ "Not a checkpoint file: " + checkpoint_path_ };
+        }
+        vector<char> saved_name = readVector<char>(in);
+        if (string(saved_name.begin(), saved_name.end()) != filename) {
+            throw runtime_error{ "Checkpoint was written for a different input: " + string(saved_name.begin(), saved_name.end()) };
+        }
+        InputIdentity saved;
+        saved.inode = readValue<uint64_t>(in);
+        saved.size = readValue<uint64_t>(in);
+        saved.modified = readValue<int64_t>(in);
+        InputIdentity current = identify(filename);
+        // A followed input keeps growing after its checkpoints, so only a
+        // shrink (or a different file) rules it out.
+        bool changed = current.inode != saved.inode || current.size < saved.size ||
+            (!keep_checkpoint_ && (current.size != saved.size || current.modified != saved.modified));
+        if (changed) {
+            throw runtime_error{ "Input " + filename + " has changed since the checkpoint was written" };
+        }
+        uint64_t position = readValue<uint64_t>(in);
+        if (readValue<uint64_t>(in) != queries_.size()) {
+            throw runtime_error{ "Checkpoint was written for a different set of filters" };
+        }
+        active_count_ = 0;
+        for (size_t q = 0; q < queries_.size(); ++q) {
+            remaining_[q] = readValue<uint64_t>(in);
+            active_[q] = readValue<char>(in);
+            active_count_ += active_[q] != 0;
+            vector<char> filter_spec = readVector<char>(in);
+            if (string(filter_spec.begin(), filter_spec.end()) != queries_[q].filter_spec) {
+                throw runtime_error{ "Checkpoint was written for a different filter: " + string(filter_spec.begin(), filter_spec.end()) };
+            }
+            if (readValue<uint64_t>(in) != queries_[q].observers.size()) {
+                throw runtime_error{ "Checkpoint was written for a different set of observers" };
+            }
+            for (size_t o = 0; o < queries_[q].observers.size(); ++o) {
+                vector<char> observer_spec = readVector<char>(in);
+                const string spec = o < queries_[q].observer_specs.size() ? queries_[q].observer_specs[o] : "";
+                if (string(observer_spec.begin(), observer_spec.end()) != spec) {
+                    throw runtime_error{ "Checkpoint was written for a different observer: " + string(observer_spec.begin(), observer_spec.end()) };
+                }
+                queries_[q].observers[o]->load_state(in);
+            }
+        }
+        return position;
+    }
+
+    static size_t compact(const int* block, const unsigned char* selected, size_t count, int* matches) {
+        size_t matched = 0;
+        for (size_t i = 0; i < count; ++i) {
+            matches[matched] = block[i];
+            matched += selected[i];
+        }
+        return matched;
+    }
+
+    void processBlock(const int* block, size_t count, vector<unsigned char>& selected, vector<int>& matches) {
+        for (size_t q = 0; q < queries_.size(); ++q) {
+            if (active_[q]) {
+                queries_[q].filter.keep_batch(block, count, selected.data());
+                deliver(q, matches.data(), compact(block, selected.data(), count, matches.data()));
+            }
+        }
+    }
+
+    void processParallel(span<const int> numbers) {
+        size_t blocks = (numbers.size() + kBlockSize - 1) / kBlockSize;
+        vector<BlockResult> results(blocks);
+        vector<char> active = active_;
+        size_t nodes = max<size_t>(1, topology_.size());
+        vector<size_t> range_end(nodes);
+        vector<atomic<size_t>> next(nodes);
+        for (size_t n = 0; n < nodes; ++n) {
+            next[n] = blocks * n / nodes;
+            range_end[n] = blocks * (n + 1) / nodes;
+        }
+        auto claim = [&](size_t home) {
+            for (size_t i = 0; i < nodes; ++i) {
+                size_t n = (home + i) % nodes;
+                if (next[n].load(memory_order_relaxed) < range_end[n]) {
+                    size_t b = next[n].fetch_add(1);
+                    if (b < range_end[n]) {
+                        return b;
+                    }
+                }
+            }
+            return blocks;
+        };
+        stop_token stop = stop_.get_token();
+        atomic<bool> failed{ false };
+        ThreadPool& pool = ThreadPool::shared();
+        auto work = [&] {
+            int worker = pool.current_index();
+            size_t home = worker < 0 ? 0 : static_cast<size_t>(worker) % nodes;
+            vector<unsigned char> selected(kBlockSize);
+            for (size_t b = claim(home); b < blocks; b = claim(home)) {
+                BlockResult& result = results[b];
+                if (!stop.stop_requested() && !failed.load(memory_order_relaxed)) {
+                    try {
+                        const int* block = numbers.data() + b * kBlockSize;
+                        size_t count = min(kBlockSize, numbers.size() - b * kBlockSize);
+                        result.matches.resize(queries_.size());
+                        for (size_t q = 0; q < queries_.size(); ++q) {
+                            if (active[q]) {
+                                queries_[q].filter.keep_batch(block, count, selected.data());
+                                result.matches[q].resize(count);
+                                result.matches[q].resize(compact(block, selected.data(), count, result.matches[q].data()));
+                            }
+                        }
+                    }
+                    catch (...) {
+                        result.error = current_exception();
+                        failed.store(true, memory_order_relaxed);
+                    }
+                }
+                result.ready.store(true, memory_order_release);
+                result.ready.notify_one();
+            }
+        };
+        TaskGroup group(pool);
+        for (size_t t = 0; t < min<size_t>(threads_, pool.size()); ++t) {
+            group.run(work);
+        }
+        exception_ptr error;
+        for (size_t b = 0; b < blocks && !stop.stop_requested(); ++b) {
+            results[b].ready.wait(false, memory_order_acquire);
+            if (results[b].error) {
+                error = results[b].error;
+                break;
+            }
+            for (size_t q = 0; q < results[b].matches.size(); ++q) {
+                deliver(q, results[b].matches[q].data(), results[b].matches[q].size());
+            }
+            if (progress_) {
+                progress_->add_numbers(min(kBlockSize, numbers.size() - b * kBlockSize));
+            }
+        }
+        group.wait();
+        if (error) {
+            rethrow_exception(error);
+        }
+    }
+
+    void deliver(size_t q, const int* numbers, size_t count) {
+        if (!active_[q] || count == 0) {
+            return;
+        }
+        Query& query = queries_[q];
+        count = static_cast<size_t>(min<uint64_t>(count, remaining_[q]));
+        remaining_[q] -= count;
+        notifyObservers(query, numbers, count);
+        bool satisfied = remaining_[q] == 0 || (!query.observers.empty() &&
+            all_of(query.observers.begin(), query.observers.end(), [](INumberObserver* observer) { return observer->satisfied(); }));
+        if (satisfied) {
+            active_[q] = 0;
+            if (--active_count_ == 0) {
+                stop_.request_stop();
+            }
+        }
+    }
+
+    void notifyObservers(Query& query, const int* numbers, size_t count) {
+        for (INumberObserver* observer : query.observers) {
+            observer->on_batch(numbers, count);
+        }
+    }
+
+    void notifySnapshot() {
+        for (Query& query : queries_) {
+            for (INumberObserver* observer : query.observers) {
+                observer->on_snapshot();
+            }
+        }
+    }
+
+    void notifyFinished() {
+        for (Query& query : queries_) {
+            for (INumberObserver* observer : query.observers) {
+                observer->on_finished();
+            }
+        }
+    }
+};
+
+void printUsage(const string& program) {
+    cerr << "Usage: " << program << " [options] <filter> [<filter> ...] <file>\n";
+    cerr << "       " << program << " --serve <socket> <name=file> [<name=file> ...]\n";
+    cerr << "       " << program << " --client <socket> [options] <filter> [<filter> ...] <dataset>\n";
+    cerr << "       " << program << " --bench-huge-pages [MiB]\n";
+    cerr << "       " << program << " --bench-scheduler [tasks]\n";
+    cerr << "Available filters: EVEN, ODD, GT<n>, LT<n>, GE<n>, BETWEEN<a>,<b>, MOD<k>,<r>, MASK<m>,<v>, IN:<file of values>\n";
+    cerr << "                   EXPR:<expression over x>, e.g. \"EXPR:x%3==0 && x>10\"\n";
+    cerr << "Combine filters with '+', e.g. EVEN+GT10 (an EXPR: filter must come last)\n";
+    cerr << "Input files may be text, binary or zstd-compressed as written by the WRITE observer\n";
+    cerr << "Options:\n";
+    cerr << "  --observer <NAME[:arg]>  attach an observer to every query (default: PRINT and COUNT)\n";
+    cerr << "                           PRINT, COUNT, EXISTS, TOPK[:k], HEAVY[:k], DISTINCT[:exact|:hll[p]],\n";
+    cerr << "                           SORTED[:memory budget in MiB], TUMBLING[:n], SLIDING[:n[,step]]\n";
+    cerr << "                           WRITE:<file> (text; .bin for binary, .zst to compress with zstd)\n";
+    cerr << "                           append @async or @async-drop to run it on its own thread\n";
+    cerr << "  --plugin <library>       load filters and observers from a shared library\n";
+    cerr << "  --limit <n>              stop each query after n matches\n";
+    cerr << "  --threads <n>            filter blocks on up to n workers of the shared thread pool\n";
+    cerr << "  --numa <n>               with --threads, schedule as if the machine had n NUMA nodes\n";
+    cerr << "                           (default: the detected topology)\n";
+    cerr << "  --pipeline <n>           read, parse (on n threads), filter and observe in separate stages\n";
+    cerr << "  --csv <column>           read one column of a CSV file, by 1-based index or header name\n";
+    cerr << "  --tsv <column>           the same for tab-separated files\n";
+    cerr << "  --header                 skip the first line when --csv/--tsv selects a column by index\n";
+    cerr << "  --follow                 keep reading as the file grows until interrupted (Ctrl+C)\n";
+    cerr << "  --snapshot <seconds>     print observer snapshots at this interval; 0 disables them\n";
+    cerr << "                           (default 60 with --follow, otherwise off)\n";
+    cerr << "  --progress <seconds>     report bytes processed, rate and ETA to stderr at this interval\n";
+    cerr << "  --checkpoint <file>      save progress to this file and resume from it if it exists\n";
+    cerr << "  --checkpoint-every <s>   seconds between checkpoints (default 30)\n";
+    cerr << "  --huge-pages <mode>      back large buffers with huge pages: off (default), thp or explicit\n";
+    cerr << "  --log-level <level>      report debug, info (default), warning or error messages and above;\n";
+    cerr << "                           each kind of message is limited to ten lines a second\n";
+    cerr << "With --serve the files are parsed once and kept in memory; --client sends a query\n";
+    cerr << "over the socket, prints the server's output and exits with the query's status.\n";
+    cerr << "--follow, --checkpoint, --csv, --tsv, --plugin, IN: filters and WRITE observers\n";
+    cerr << "do not apply to datasets.\n";
+}
+
+atomic<bool> interrupted{ false };
+
+// Runs one command line worth of queries. With `datasets` the last positional
+// argument names a loaded dataset instead of a file.
+int runQueries(const string& program, const vector<string>& args, const Datasets* datasets) {
+    vector<string> positional;
+    vector<string> observer_specs;
+    vector<string> plugin_paths;
+    uint64_t limit = UINT64_MAX;
+    unsigned threads = 1;
+    unsigned parsers = 0;
+    size_t numa_nodes = 0;
+    bool follow = false;
+    optional<uint64_t> snapshot_seconds;
+    uint64_t progress_seconds = 0;
+    string checkpoint_path;
+    uint64_t checkpoint_seconds = 30;
+    optional<char> delimiter;
+    string column;
+    bool header = false;
+    for (size_t i = 0; i < args.size(); ++i) {
+        const string& arg = args[i];
+        if (!arg.starts_with("--")) {
+            positional.push_back(arg);
+            continue;
+        }
+        if (arg == "--follow") {
+            follow = true;
+            continue;
+        }
+        if (arg == "--header") {
+            header = true;
+            continue;
+        }
+        if (i + 1 >= args.size()) {
+            cerr << "Error: Missing value for option " << arg << endl;
+            return 1;
+        }
+        if (arg == "--observer") {
+            observer_specs.push_back(args[++i]);
+        }
+        else if (arg == "--plugin") {
+            plugin_paths.push_back(args[++i]);
+        }
+        else if (arg == "--checkpoint") {
+            checkpoint_path = args[++i];
+        }
+        else if (arg == "--csv" || arg == "--tsv") {
+            delimiter = arg == "--csv" ? ',' : '\t';
+            column = args[++i];
+        }
+        else if (arg == "--limit" || arg == "--threads" || arg == "--snapshot" || arg == "--checkpoint-every" || arg == "--numa" || arg == "--progress" || arg == "--pipeline") {
+            const string& value = args[++i];
+            try {
+                size_t used = 0;
+                unsigned long long parsed = stoull(value, &used);
+                if (used != value.size() || value.starts_with("-") || ((arg == "--threads" || arg == "--numa" || arg == "--pipeline") && (parsed == 0 || parsed > 1024))) {
+                    throw invalid_argument{ value };
+                }
+                if (arg == "--limit") {
+                    limit = parsed;
+                }
+                else if (arg == "--snapshot") {
+                    snapshot_seconds = parsed;
+                }
+                else if (arg == "--checkpoint-every") {
+                    checkpoint_seconds = parsed;
+                }
+                else if (arg == "--numa") {
+                    numa_nodes = parsed;
+                }
+                else if (arg == "--progress") {
+                    progress_seconds = parsed;
+                }
+                else if (arg == "--pipeline") {
+                    parsers = static_cast<unsigned>(parsed);
+                }
+                else {
+                    threads = static_cast<unsigned>(parsed);
+                }
+            }
+            catch (const logic_error&) {
+                cerr << "Error: Invalid value for " << arg << ": " << value << endl;
+                return 1;
+            }
+        }
+        else {
+            cerr << "Error: Unknown option " << arg << endl;
+            printUsage(program);
+            return 1;
+        }
+    }
+    if (positional.size() < 2) {
+        printUsage(program);
+        return 1;
+    }
+    if (datasets && (follow || !checkpoint_path.empty() || delimiter || !plugin_paths.empty())) {
+        cerr << "Error: --follow, --checkpoint, --csv, --tsv and --plugin cannot be used with datasets" << endl;
+        return 1;
+    }
+    if (follow && delimiter) {
+        cerr << "Error: --follow cannot be combined with --csv or --tsv" << endl;
+        return 1;
+    }
+    if (parsers > 0 && (threads > 1 || follow || delimiter || datasets)) {
+        cerr << "Error: --pipeline reads plain input files and cannot be combined with --threads, --follow, --csv, --tsv or datasets" << endl;
+        return 1;
+    }
+    if (observer_specs.empty()) {
+        observer_specs = { "PRINT", "COUNT" };
+    }
+
+    vector<string> filter_args(positional.begin(), positional.end() - 1);
+    string filename = positional.back();
+
+    PluginLibraries plugins;
+    FilterFactory factory;
+    ObserverFactory observer_factory;
+    vector<unique_ptr<INumberFilter>> filters;
+    vector<unique_ptr<INumberObserver>> owned_observers;
+    vector<Query> queries;
+    // Dataset queries come from whoever can reach the server's socket, so
+    // they may not read or write the server's files.
+    if (datasets) {
+        factory.registerFilter("IN", [](const string&) -> unique_ptr<INumberFilter> {
+            throw invalid_argument{ "IN filters cannot be used with datasets" };
+            });
+        observer_factory.registerObserver("WRITE", [](const string&, const string&) -> unique_ptr<INumberObserver> {
+            throw invalid_argument{ "WRITE observers cannot be used with datasets" };
+            });
+    }
+
+    try {
+        for (const string& plugin_path : plugin_paths) {
+            plugins.load(plugin_path, factory, observer_factory);
+        }
+        for (const string& filter_arg : filter_args) {
+            filters.push_back(factory.createFilterFromSpec(filter_arg));
+        }
+        // A single query keeps the original unlabelled output.
+        bool labelled = filters.size() > 1;
+        for (size_t i = 0; i < filters.size(); ++i) {
+            string label = labelled ? filter_args[i] : "";
+            vector<INumberObserver*> observers;
+            for (const string& observer_spec : observer_specs) {
+                owned_observers.push_back(observer_factory.createObserverFromSpec(observer_spec, label));
+                observers.push_back(owned_observers.back().get());
+            }
+            queries.push_back(Query{ *filters[i], observers, limit, filter_args[i], observer_specs });
+        }
+    }
+    catch (const invalid_argument& e) {
+        cerr << "Error: " << e.what() << endl;
+        return 1;
+    }
+    catch (const out_of_range& e) {
+        cerr << "Error: " << e.what() << endl;
+        return 1;
+    }
+    catch (const runtime_error& e) {
+        cerr << "Error: " << e.what() << endl;
+        return 1;
+    }
+
+    FileReader file_reader;
+    FollowingFileReader following_reader([] { return interrupted.load(); });
+    optional<DatasetReader> dataset_reader;
+    if (datasets) {
+        dataset_reader.emplace(*datasets);
+    }
+    optional<DelimitedReader> delimited_reader;
+    if (delimiter) {
+        delimited_reader.emplace(*delimiter, column, header);
+    }
+    INumberReader& reader = dataset_reader ? static_cast<INumberReader&>(*dataset_reader)
+        : delimited_reader ? static_cast<INumberReader&>(*delimited_reader)
+        : follow ? static_cast<INumberReader&>(following_reader) : file_reader;
+    if (follow) {
+        signal(SIGINT, [](int) { interrupted = true; });
+        if (!snapshot_seconds) {
+            snapshot_seconds = 60;
+        }
+    }
+
+    Logger::instance().set_async(true);
+    // Flushes and leaves asynchronous mode on every way out, while the shared
+    // pool is certainly still alive.
+    unique_ptr<Logger, void (*)(Logger*)> async_guard(&Logger::instance(), [](Logger* logger) {
+        logger->set_async(false);
+        });
+    NumberProcessor processor(reader, queries);
+    processor.set_threads(threads);
+    processor.set_pipeline(parsers);
+    if (threads > 1) {
+        processor.set_topology(numa_nodes > 0 ? NumaTopology::emulate(numa_nodes) : NumaTopology::detect());
+    }
+    processor.set_snapshot_interval(chrono::seconds(snapshot_seconds.value_or(0)));
+    processor.set_progress_interval(chrono::seconds(progress_seconds));
+    if (!checkpoint_path.empty()) {
+        processor.set_checkpoint(checkpoint_path, chrono::seconds(checkpoint_seconds), follow);
+    }
+    return processor.run(filename) ? 0 : 1;
+}
+
+#if defined(__unix__) || defined(__APPLE__)
+// Requests are the query's command line arguments, one per line, ended by an
+// empty line. Each connection is answered by a forked child that shares the
+// parsed datasets copy-on-write and writes its output straight to the socket,
+// so concurrent queries never copy or lock the data; the output ends with a
+// status marker and the query's exit status. Queries may not load plugins or
+// touch the server's files.
+class QueryServer {
+private:
+    // Ends the query's output, followed by one byte of exit status. Query
+    // output is text and never contains it.
+    static constexpr char kStatusMarker = '\0';
+    int listen_fd_ = -1;
+    string path_;
+    const Datasets& datasets_;
+
+    static sockaddr_un socketAddress(const string& path) {
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        if (path.size() >= sizeof(address.sun_path)) {
+            throw runtime_error{ "Socket path is too long: " + path };
+        }
+        path.copy(address.sun_path, path.size());
+        return address;
+    }
+
+    static vector<string> readRequest(int fd) {
+        vector<string> args;
+        string line;
+        char c;
+        while (::read(fd, &c, 1) == 1) {
+            if (c != '\n') {
+                line += c;
+                continue;
+            }
+            if (line.empty()) {
+                break;
+            }
+            args.push_back(move(line));
+            line.clear();
+        }
+        return args;
+    }
+
+    void answer(int fd, const string& program) {
+        vector<string> args = readRequest(fd);
+        cout.flush();
+        dup2(fd, STDOUT_FILENO);
+        dup2(fd, STDERR_FILENO);
+        close(fd);
+        int status = runQueries(program, args, &datasets_);
+        cout.flush();
+        cerr.flush();
+        const char trailer[2] = { kStatusMarker, static_cast<char>(status) };
+        ::write(STDOUT_FILENO, trailer, sizeof(trailer));
+        _exit(status);
+    }
+
+public:
+    QueryServer(const string& path, const Datasets& datasets) : path_(path), datasets_(datasets) {
+        sockaddr_un address = socketAddress(path);
+        listen_fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listen_fd_ < 0) {
+            throw runtime_error{ "Could not create socket" };
+        }
+        unlink(path.c_str());
+        if (bind(listen_fd_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(listen_fd_, 64) != 0) {
+            close(listen_fd_);
+            throw runtime_error{ "Could not listen on socket: " + path };
+        }
+    }
+    QueryServer(const QueryServer&) = delete;
+    QueryServer& operator=(const QueryServer&) = delete;
+    ~QueryServer() {
+        close(listen_fd_);
+        unlink(path_.c_str());
+    }
+
+    void serve(const string& program, const atomic<bool>& should_stop) {
+        signal(SIGCHLD, SIG_IGN);
+        while (!should_stop) {
+            pollfd ready{ listen_fd_, POLLIN, 0 };
+            if (poll(&ready, 1, 500) <= 0) {
+                continue;
+            }
+            int fd = accept(listen_fd_, nullptr, nullptr);
+            if (fd < 0) {
+                continue;
+            }
+            pid_t child = fork();
+            if (child == 0) {
+                close(listen_fd_);
+                answer(fd, program);
+            }
+            if (child < 0) {
+                const char message[] = "Error: server could not start a query\n\0\1";
+                ::write(fd, message, sizeof(message) - 1);
+            }
+            close(fd);
+        }
+    }
+
+    static int query(const string& path, const vector<string>& args) {
+        sockaddr_un address = socketAddress(path);
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0 || connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+            if (fd >= 0) {
+                close(fd);
+            }
+            throw runtime_error{ "Could not connect to server: " + path };
+        }
+        string request;
+        for (const string& arg : args) {
+            if (arg.empty() || arg.find('\n') != string::npos) {
+                close(fd);
+                throw invalid_argument{ "Query arguments must be non-empty single lines" };
+            }
+            request += arg + '\n';
+        }
+        request += '\n';
+        for (size_t sent = 0; sent < request.size();) {
+            ssize_t written = ::write(fd, request.data() + sent, request.size() - sent);
+            if (written <= 0) {
+                close(fd);
+                throw runtime_error{ "Could not send query to server" };
+            }
+            sent += static_cast<size_t>(written);
+        }
+        char buffer[1 << 16];
+        bool marked = false;
+        optional<int> status;
+        while (!status) {
+            ssize_t got = ::read(fd, buffer, sizeof(buffer));
+            if (got <= 0) {
+                break;
+            }
+            const char* data = buffer;
+            const char* end = buffer + got;
+            if (!marked) {
+                const char* marker = find(data, end, kStatusMarker);
+                cout.write(data, marker - data);
+                if (marker == end) {
+                    continue;
+                }
+                marked = true;
+                data = marker + 1;
+            }
+            if (data < end) {
+                status = static_cast<unsigned char>(*data);
+            }
+        }
+        cout.flush();
+        close(fd);
+        if (!status) {
+            throw runtime_error{ "Server closed the connection without reporting the query's status" };
+        }
+        return *status;
+    }
+};
+
+Datasets loadDatasets(const vector<string>& specs) {
+    Datasets datasets;
+    FileReader reader;
+    for (const string& spec : specs) {
+        size_t equals = spec.find('=');
+        string name = equals == string::npos ? spec : spec.substr(0, equals);
+        string filename = equals == string::npos ? spec : spec.substr(equals + 1);
+        NumberBuffer& numbers = datasets[name];
+        numbers.clear();
+        for (span<const int> batch : reader.stream(filename)) {
+            numbers.insert(numbers.end(), batch.begin(), batch.end());
+        }
+        numbers.shrink_to_fit();
+        // Reports the file's suppressed warnings here rather than in every
+        // forked child.
+        Logger::instance().flush();
+        Logger::instance().log(LogLevel::INFO, "Loaded dataset " + name + ": " + to_string(numbers.size()) + " numbers");
+    }
+    return datasets;
+}
+#endif
+
+HugePages parseHugePages(const string& mode) {
+    if (mode == "off") {
+        return HugePages::OFF;
+    }
+    if (mode == "thp") {
+        return HugePages::TRANSPARENT;
+    }
+    if (mode == "explicit") {
+        return HugePages::EXPLICIT;
+    }
+    throw invalid_argument{ "Unknown huge page mode: " + mode + " (expected off, thp or explicit)" };
+}
+
+LogLevel parseLogLevel(const string& level) {
+    if (level == "debug") {
+        return LogLevel::DEBUG;
+    }
+    if (level == "info") {
+        return LogLevel::INFO;
+    }
+    if (level == "warning") {
+        return LogLevel::WARNING;
+    }
+    if (level == "error") {
+        return LogLevel::ERROR;
+    }
+    throw invalid_argument{ "Unknown log level: " + level + " (expected debug, info, warning or error)" };
+}
+
+// Counts data TLB load misses of this thread where perf events are available.
+class TlbMissCounter {
+private:
+    int fd_ = -1;
+
+public:
+    TlbMissCounter() {
+#if defined(__linux__)
+        perf_event_attr attr{};
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.size = sizeof(attr);
+        attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd_ = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+#endif
+    }
+    TlbMissCounter(const TlbMissCounter&) = delete;
+    TlbMissCounter& operator=(const TlbMissCounter&) = delete;
+    ~TlbMissCounter() {
+#if defined(__linux__)
+        if (fd_ >= 0) {
+            close(fd_);
+        }
+#endif
+    }
+    bool available() const {
+        return fd_ >= 0;
+    }
+    void start() {
+#if defined(__linux__)
+        if (fd_ >= 0) {
+            ioctl(fd_, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+    }
+    uint64_t stop() {
+        uint64_t misses = 0;
+#if defined(__linux__)
+        if (fd_ >= 0) {
+            ioctl(fd_, PERF_EVENT_IOC_DISABLE, 0);
+            if (::read(fd_, &misses, sizeof(misses)) != sizeof(misses)) {
+                misses = 0;
+            }
+        }
+#endif
+        return misses;
+    }
+};
+
+// Random reads over a buffer much larger than the TLB reach of 4 KiB pages,
+// timed under each huge page mode, with the dTLB load misses when the kernel
+// exposes them.
+int benchmarkHugePages(size_t mebibytes) {
+    constexpr size_t kAccesses = 1 << 25;
+    size_t count = mebibytes * (1 << 20) / sizeof(int);
+    TlbMissCounter counter;
+    cout << "Random reads of " << kAccesses << " ints from a " << mebibytes << " MiB buffer" << endl;
+    const pair<HugePages, const char*> modes[] = {
+        { HugePages::OFF, "off" }, { HugePages::TRANSPARENT, "thp" }, { HugePages::EXPLICIT, "explicit" } };
+    for (auto [mode, name] : modes) {
+        huge_page_mode = mode;
+        NumberBuffer buffer(count);
+        for (size_t i = 0; i < count; ++i) {
+            buffer[i] = static_cast<int>(i);
+        }
+        uint64_t state = 88172645463325252ull;
+        int64_t sum = 0;
+        counter.start();
+        auto start = chrono::steady_clock::now();
+        for (size_t i = 0; i < kAccesses; ++i) {
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            sum += buffer[state % count];
+        }
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        uint64_t misses = counter.stop();
+        cout << setw(9) << name << ": " << fixed << setprecision(2) << seconds * 1e9 / kAccesses << " ns/read";
+        if (counter.available()) {
+            cout << ", " << misses << " dTLB load misses";
+        }
+        cout << " (checksum " << sum << ")" << endl;
+    }
+    huge_page_mode = HugePages::OFF;
+    if (!counter.available()) {
+        cout << "dTLB miss counts are unavailable (perf events not permitted)" << endl;
+    }
+    return 0;
+}
+
+// Cost of scheduling empty tasks on the shared pool: submitted from outside
+// the pool (injection queue), spawned by one task (owner deque, stolen by the
+// others) and as a recursive fork-join tree, against a thread per task.
+int benchmarkScheduler(size_t tasks) {
+    ThreadPool& pool = ThreadPool::shared();
+    atomic<uint64_t> sink{ 0 };
+    auto empty = [&sink] { sink.fetch_add(1, memory_order_relaxed); };
+    auto report = [](const char* name, size_t count, chrono::steady_clock::time_point start) {
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        cout << setw(12) << name << ": " << fixed << setprecision(1) << seconds * 1e9 / count << " ns/task" << endl;
+    };
+    cout << "Scheduling " << tasks << " empty tasks on " << pool.size() << " worker(s)" << endl;
+
+    auto start = chrono::steady_clock::now();
+    {
+        TaskGroup group(pool);
+        for (size_t i = 0; i < tasks; ++i) {
+            group.run(empty);
+        }
+        group.wait();
+    }
+    report("external", tasks, start);
+
+    start = chrono::steady_clock::now();
+    {
+        TaskGroup outer(pool);
+        outer.run([&] {
+            TaskGroup group(pool);
+            for (size_t i = 0; i < tasks; ++i) {
+                group.run(empty);
+            }
+            group.wait();
+            });
+        outer.wait();
+    }
+    report("spawned", tasks, start);
+
+    function<void(size_t)> split = [&](size_t count) {
+        if (count <= 1) {
+            empty();
+            return;
+        }
+        TaskGroup group(pool);
+        group.run([&split, count] { split(count / 2); });
+        split(count - count / 2);
+        group.wait();
+    };
+    start = chrono::steady_clock::now();
+    {
+        TaskGroup outer(pool);
+        outer.run([&] { split(tasks); });
+        outer.wait();
+    }
+    report("fork-join", tasks, start);
+
+    size_t spawned = min<size_t>(tasks, 10000);
+    start = chrono::steady_clock::now();
+    for (size_t i = 0; i < spawned; ++i) {
+        thread(empty).join();
+    }
+    report("thread", spawned, start);
+
+    if (sink.load() != 3 * tasks + spawned) {
+        cerr << "Error: " << sink.load() << " tasks ran instead of " << 3 * tasks + spawned << endl;
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    vector<string> args(argv + 1, argv + argc);
+    // Diagnostics go to stderr, since stdout carries the results, and each
+    // message site is limited to ten lines a second so a dirty input cannot
+    // make the parser wait on the terminal.
+    Logger& logger = Logger::instance();
+    logger.set_sink(SinkType::STDERR, false);
+    logger.set_show_location(false);
+    logger.set_level(LogLevel::INFO);
+    logger.set_rate_limit(10, chrono::seconds(1));
+    try {
+        auto option = find(args.begin(), args.end(), "--huge-pages");
+        if (option != args.end()) {
+            if (option + 1 == args.end()) {
+                throw invalid_argument{ "Missing value for option --huge-pages" };
+            }
+            huge_page_mode = parseHugePages(*(option + 1));
+            args.erase(option, option + 2);
+        }
+        option = find(args.begin(), args.end(), "--log-level");
+        if (option != args.end()) {
+            if (option + 1 == args.end()) {
+                throw invalid_argument{ "Missing value for option --log-level" };
+            }
+            logger.set_level(parseLogLevel(*(option + 1)));
+            args.erase(option, option + 2);
+        }
+    }
+    catch (const invalid_argument& e) {
+        cerr << "Error: " << e.what() << endl;
+        return 1;
+    }
+    if (!args.empty() && args[0] == "--bench-huge-pages") {
+        try {
+            size_t mebibytes = args.size() > 1 ? stoul(args[1]) : 1024;
+            if (mebibytes == 0) {
+                throw invalid_argument{ args[1] };
+            }
+            return benchmarkHugePages(mebibytes);
+        }
+        catch (const logic_error&) {
+            cerr << "Error: Invalid buffer size for --bench-huge-pages: " << args[1] << endl;
+            return 1;
+        }
+    }
+    if (!args.empty() && args[0] == "--bench-scheduler") {
+        try {
+            size_t tasks = args.size() > 1 ? stoul(args[1]) : 1000000;
+            if (tasks == 0) {
+                throw invalid_argument{ args[1] };
+            }
+            return benchmarkScheduler(tasks);
+        }
+        catch (const logic_error&) {
+            cerr << "Error: Invalid task count for --bench-scheduler: " << args[1] << endl;
+            return 1;
+        }
+    }
+    if (!args.empty() && (args[0] == "--serve" || args[0] == "--client")) {
+#if defined(__unix__) || defined(__APPLE__)
+        if (args.size() < 3) {
+            printUsage(argv[0]);
+            return 1;
+        }
+        try {
+            if (args[0] == "--client") {
+                return QueryServer::query(args[1], vector<string>(args.begin() + 2, args.end()));
+            }
+            Datasets datasets = loadDatasets(vector<string>(args.begin() + 2, args.end()));
+            QueryServer server(args[1], datasets);
+            signal(SIGINT, [](int) { interrupted = true; });
+            signal(SIGTERM, [](int) { interrupted = true; });
+            cerr << "Serving " << datasets.size() << " dataset(s) on " << args[1] << endl;
+            server.serve(argv[0], interrupted);
+        }
+        catch (const invalid_argument& e) {
+            cerr << "Error: " << e.what() << endl;
+            return 1;
+        }
+        catch (const runtime_error& e) {
+            cerr << "Error: " << e.what() << endl;
+            return 1;
+        }
+        return 0;
+#else
+        cerr << "Error: " << args[0] << " is not supported on this platform" << endl;
+        return 1;
+#endif
+    }
+    return runQueries(argv[0], args, nullptr);
 }
\ No newline at end of file
@@ -0,0 +1,300 @@
+﻿#pragma once
+
+// Process-wide logger shared by both programs. Messages below the configured
+// level are dropped, each call site may be rate limited (the overflow is
+// counted and summarised instead of written), and in asynchronous mode the
+// sink is written by a task on the shared ThreadPool so the caller only pays
+// for formatting and a queue push.
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <source_location>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "ThreadPool.h"
+
+struct LogSink {
+    virtual void write(const std::string& msg) = 0;
+    virtual ~LogSink() = default;
+};
+struct ConsoleSink : public LogSink {
+    void write(const std::string& msg) override {
+        std::cout << msg << std::endl;
+    }
+};
+// For programs whose standard output is data, not diagnostics.
+struct ErrorSink : public LogSink {
+    void write(const std::string& msg) override {
+        std::cerr << msg + '\n';
+    }
+};
+struct FileSink : public LogSink {
+    FileSink() : file_("app.log", std::ios::app), file_open_(file_.is_open()) {
+        if (!file_open_) {
+            std::cerr << "Error opening file app.log for writing." << std::endl;
+        }
+    }
+    void write(const std::string& msg) override {
+        if (file_open_) {
+            file_ << msg << std::endl;
+            if (file_.fail()) {
+                std::cerr << "Error writing to file app.log." << std::endl;
+            }
+        }
+        else {
+            std::cerr << "Error: File app.log is not open." << std::endl;
+        }
+    }
+private:
+    std::ofstream file_;
+    bool file_open_;
+};
+
+struct NullSink : public LogSink {
+    void write(const std::string& /*msg*/) override {}
+};
+
+enum class SinkType { CONSOLE, STDERR, FILE, NONE };
+
+enum class LogLevel { DEBUG, INFO, WARNING, ERROR };
+
+class Logger {
+public:
+    static Logger& instance() {
+        static Logger instance_;
+        return instance_;
+    }
+
+    // Announces the new sink on standard output unless `announce` is false.
+    void set_sink(SinkType type, bool announce = true) {
+        flush();
+        std::lock_guard lock(mutex_);
+        std::lock_guard sink_lock(sink_mutex_);
+        switch (type) {
+        case SinkType::CONSOLE:
+            sink_ = std::make_unique<ConsoleSink>();
+            current_sink_type_ = SinkType::CONSOLE;
+            if (announce) {
+                std::cout << "Logging redirected to console." << std::endl;
+            }
+            break;
+        case SinkType::STDERR:
+            sink_ = std::make_unique<ErrorSink>();
+            current_sink_type_ = SinkType::STDERR;
+            if (announce) {
+                std::cout << "Logging redirected to stderr." << std::endl;
+            }
+            break;
+        case SinkType::FILE:
+            sink_ = std::make_unique<FileSink>();
+            current_sink_type_ = SinkType::FILE;
+            if (announce) {
+                std::cout << "Logging redirected to file app.log." << std::endl;
+            }
+            break;
+        case SinkType::NONE:
+            sink_ = std::make_unique<NullSink>();
+            current_sink_type_ = SinkType::NONE;
+            if (announce) {
+                std::cout << "Logging disabled." << std::endl;
+            }
+            break;
+        default:
+            std::cerr << "Unknown sink type. Previous sink remains." << std::endl;
+            break;
+        }
+    }
+
+    void set_level(LogLevel level) {
+        std::lock_guard lock(mutex_);
+        level_ = level;
+    }
+
+    // Prefixes messages with the file, function and line that logged them.
+    void set_show_location(bool show) {
+        std::lock_guard lock(mutex_);
+        show_location_ = show;
+    }
+
+    // Lets each call site write at most `burst` messages per `interval`; the
+    // rest are counted and reported as one line when the site next writes or
+    // at flush(). A burst of zero turns rate limiting off.
+    void set_rate_limit(size_t burst, std::chrono::milliseconds interval) {
+        std::lock_guard lock(mutex_);
+        burst_ = burst;
+        interval_ = interval;
+        sites_.clear();
+    }
+
+    // When asynchronous, log() only queues the formatted message and a task on
+    // the shared thread pool writes queued messages to the sink in order.
+    void set_async(bool async) {
+        flush();
+        if (async && !background_) {
+            background_ = std::make_unique<TaskGroup>(ThreadPool::shared());
+        }
+        else if (!async) {
+            background_.reset();
+        }
+    }
+
+    void log(const std::string& msg, const std::source_location& location = std::source_location::current()) {
+        log(LogLevel::INFO, msg, location);
+    }
+
+    void log(LogLevel level, const std::string& msg, const std::source_location& location = std::source_location::current()) {
+        std::lock_guard lock(mutex_);
+        if (level < level_) {
+            return;
+        }
+        if (!sink_) {
+            std::cerr << "Error: Sink not set." << std::endl;
+            return;
+        }
+        if (burst_ > 0) {
+            Site& site = sites_[{ reinterpret_cast<uintptr_t>(location.file_name()), location.line() }];
+            auto now = std::chrono::steady_clock::now();
+            if (now - site.window_start >= interval_) {
+                reportSuppressed(site, location);
+                site.window_start = now;
+                site.written = 0;
+            }
+            if (site.written == burst_) {
+                if (site.suppressed++ == 0) {
+                    site.example = msg;
+                }
+                return;
+            }
+            ++site.written;
+        }
+        emit(formatLogMessage(msg, location));
+    }
+
+    // Reports any suppressed messages and waits until everything queued has
+    // been written.
+    void flush() {
+        {
+            std::lock_guard lock(mutex_);
+            for (auto& [key, site] : sites_) {
+                reportSuppressed(site, site.location);
+            }
+        }
+        if (background_) {
+            background_->wait();
+        }
+    }
+
+    SinkType get_current_sink_type() const {
+        return current_sink_type_;
+    }
+
+private:
+    struct Site {
+        std::chrono::steady_clock::time_point window_start;
+        size_t written = 0;
+        size_t suppressed = 0;
+        std::string example;
+        std::source_location location;
+    };
+
+    std::unique_ptr<LogSink> sink_;
+    SinkType current_sink_type_ = SinkType::CONSOLE; // Default to console
+    LogLevel level_ = LogLevel::DEBUG;
+    bool show_location_ = true;
+    size_t burst_ = 0;
+    std::chrono::milliseconds interval_{ 1000 };
+    std::map<std::pair<uintptr_t, uint_least32_t>, Site> sites_;
+    std::unique_ptr<TaskGroup> background_;
+    std::mutex mutex_;
+    // Guards sink_ while it is written, since drain() writes without mutex_.
+    // Taken after mutex_ when both are held.
+    std::mutex sink_mutex_;
+    std::vector<std::string> pending_;
+    bool draining_ = false;
+    Logger() : sink_(std::make_unique<ConsoleSink>()) {}
+    // The shared pool may already have been destroyed, so nothing is submitted
+    // to it here: whatever is still queued and the suppressed-message
+    // summaries are written directly, and the task group is abandoned.
+    ~Logger() {
+        std::lock_guard lock(mutex_);
+        (void)background_.release();
+        std::lock_guard sink_lock(sink_mutex_);
+        for (const std::string& line : pending_) {
+            sink_->write(line);
+        }
+        pending_.clear();
+        for (auto& [key, site] : sites_) {
+            if (site.suppressed > 0) {
+                sink_->write(formatLogMessage("Suppressed " + std::to_string(site.suppressed) + " more message(s) like: " + site.example, site.location));
+            }
+        }
+    }
+    Logger(const Logger&) = delete;
+    Logger& operator=(const Logger&) = delete;
+
+    // Called with mutex_ held.
+    void emit(std::string line) {
+        if (background_) {
+            pending_.push_back(std::move(line));
+            if (!draining_) {
+                draining_ = true;
+                background_->run([this] { drain(); });
+            }
+        }
+        else {
+            std::lock_guard sink_lock(sink_mutex_);
+            sink_->write(line);
+        }
+    }
+
+    // Called with mutex_ held.
+    void reportSuppressed(Site& site, const std::source_location& location) {
+        site.location = location;
+        if (site.suppressed > 0) {
+            emit(formatLogMessage("Suppressed " + std::to_string(site.suppressed) + " more message(s) like: " + site.example, location));
+            site.suppressed = 0;
+            site.example.clear();
+        }
+    }
+
+    // At most one drain task runs at a time; it swaps out whatever has been
+    // queued and writes it without holding the lock.
+    void drain() {
+        std::vector<std::string> batch;
+        while (true) {
+            {
+                std::lock_guard lock(mutex_);
+                if (pending_.empty()) {
+                    draining_ = false;
+                    return;
+                }
+                batch.swap(pending_);
+            }
+            {
+                std::lock_guard sink_lock(sink_mutex_);
+                for (const std::string& line : batch) {
+                    sink_->write(line);
+                }
+            }
+            batch.clear();
+        }
+    }
+
+    std::string formatLogMessage(const std::string& msg, const std::source_location& location) {
+        if (!show_location_) {
+            return msg;
+        }
+        std::stringstream ss;
+        ss << "[" << location.file_name() << ":" << location.function_name() << ":" << location.line() << "] " << msg;
+        return ss.str();
+    }
+};
@@ -0,0 +1,48 @@
+﻿#pragma once
+
+// C ABI for filter and observer plugins loaded with --plugin <library>.
+// A plugin exports NUMBER_PLUGIN_ENTRY_NAME as a NumberPluginEntry and uses the
+// registry to add its factories by name. Create callbacks return 0 on success.
+
+#include <stddef.h>
+
+#ifdef _WIN32
+#define NUMBER_PLUGIN_EXPORT __declspec(dllexport)
+#else
+#define NUMBER_PLUGIN_EXPORT __attribute__((visibility("default")))
+#endif
+
+#define NUMBER_PLUGIN_ENTRY_NAME "number_plugin_register"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct NumberPluginFilter {
+    void* state;
+    int (*keep)(void* state, int number);
+    void (*keep_batch)(void* state, const int* numbers, size_t count, unsigned char* selected);
+    void (*destroy)(void* state);
+} NumberPluginFilter;
+
+typedef struct NumberPluginObserver {
+    void* state;
+    void (*on_batch)(void* state, const int* numbers, size_t count);
+    void (*on_finished)(void* state);
+    void (*destroy)(void* state);
+} NumberPluginObserver;
+
+typedef int (*NumberPluginFilterCreate)(const char* arg, NumberPluginFilter* out);
+typedef int (*NumberPluginObserverCreate)(const char* arg, const char* label, NumberPluginObserver* out);
+
+typedef struct NumberPluginRegistry {
+    void* host;
+    void (*register_filter)(void* host, const char* name, NumberPluginFilterCreate create);
+    void (*register_observer)(void* host, const char* name, NumberPluginObserverCreate create);
+} NumberPluginRegistry;
+
+typedef void (*NumberPluginEntry)(const NumberPluginRegistry* registry);
+
+#ifdef __cplusplus
+}
+#endif
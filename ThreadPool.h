@@ -0,0 +1,392 @@
+﻿#pragma once
+
+// Work-stealing task scheduler shared by the Logger and NumberProcessor.
+// Every worker owns a Chase-Lev deque: it pushes and pops its own tasks at the
+// bottom while idle workers steal from the top. Tasks submitted from threads
+// outside the pool go through a locked injection queue. Idle workers park on
+// an atomic wait (a futex on Linux) and are woken only when a submitter sees
+// that someone is parked, so a busy pool never makes a system call.
+//
+// Work is submitted through a TaskGroup, whose wait() returns once the group's
+// tasks have finished and rethrows the first exception any of them threw. A
+// worker that waits keeps running queued tasks in the meantime.
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+class TaskGroup;
+
+class ThreadPool {
+public:
+    explicit ThreadPool(unsigned workers = std::max(1u, std::thread::hardware_concurrency())) {
+        workers_.reserve(workers);
+        for (unsigned i = 0; i < workers; ++i) {
+            workers_.push_back(std::make_unique<Worker>(*this, i));
+        }
+        for (auto& worker : workers_) {
+            worker->thread = std::thread(&ThreadPool::workerLoop, this, std::ref(*worker));
+        }
+    }
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Runs every task that is still queued before the workers exit.
+    ~ThreadPool() {
+        stopping_.store(true, std::memory_order_seq_cst);
+        wake_.fetch_add(1, std::memory_order_seq_cst);
+        wake_.notify_all();
+        for (auto& worker : workers_) {
+            worker->thread.join();
+        }
+    }
+
+    // One worker per hardware thread, started on first use. A process that
+    // forks must not have used it yet: the children would inherit the pool
+    // without its threads.
+    static ThreadPool& shared() {
+        static ThreadPool pool;
+        return pool;
+    }
+
+    size_t size() const {
+        return workers_.size();
+    }
+
+    // For pinning workers to CPUs; the pool itself does not pin them.
+    std::thread& worker(size_t index) {
+        return workers_[index]->thread;
+    }
+
+    // The index of the worker of this pool running the calling thread, or -1.
+    int current_index() const {
+        return current_ && &current_->pool == this ? static_cast<int>(current_->index) : -1;
+    }
+
+private:
+    friend class TaskGroup;
+
+    struct Task {
+        TaskGroup* group = nullptr;
+        virtual void run() = 0;
+        virtual ~Task() = default;
+    };
+
+    // Chase-Lev deque with the memory orderings of Le et al., "Correct and
+    // Efficient Work-Stealing for Weak Memory Models". Only the owner calls
+    // push and pop; any thread may steal. Outgrown arrays are kept until the
+    // deque is destroyed, since a thief may still be reading one.
+    class Deque {
+    private:
+        struct Array {
+            int64_t capacity;
+            std::unique_ptr<std::atomic<Task*>[]> slots;
+
+            explicit Array(int64_t capacity) : capacity(capacity), slots(new std::atomic<Task*>[capacity]) {
+            }
+            Task* get(int64_t i) const {
+                return slots[i & (capacity - 1)].load(std::memory_order_relaxed);
+            }
+            void put(int64_t i, Task* task) {
+                slots[i & (capacity - 1)].store(task, std::memory_order_relaxed);
+            }
+        };
+
+        alignas(64) std::atomic<int64_t> top_{ 0 };
+        alignas(64) std::atomic<int64_t> bottom_{ 0 };
+        std::atomic<Array*> array_;
+        std::vector<std::unique_ptr<Array>> arrays_;
+
+    public:
+        Deque() {
+            arrays_.push_back(std::make_unique<Array>(256));
+            array_.store(arrays_.back().get(), std::memory_order_relaxed);
+        }
+
+        void push(Task* task) {
+            int64_t b = bottom_.load(std::memory_order_relaxed);
+            int64_t t = top_.load(std::memory_order_acquire);
+            Array* array = array_.load(std::memory_order_relaxed);
+            if (b - t > array->capacity - 1) {
+                auto grown = std::make_unique<Array>(array->capacity * 2);
+                for (int64_t i = t; i < b; ++i) {
+                    grown->put(i, array->get(i));
+                }
+                array = grown.get();
+                arrays_.push_back(std::move(grown));
+                array_.store(array, std::memory_order_release);
+            }
+            array->put(b, task);
+            std::atomic_thread_fence(std::memory_order_release);
+            bottom_.store(b + 1, std::memory_order_relaxed);
+        }
+
+        Task* pop() {
+            int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+            Array* array = array_.load(std::memory_order_relaxed);
+            bottom_.store(b, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int64_t t = top_.load(std::memory_order_relaxed);
+            if (t > b) {
+                bottom_.store(b + 1, std::memory_order_relaxed);
+                return nullptr;
+            }
+            Task* task = array->get(b);
+            if (t == b) {
+                if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                    task = nullptr;
+                }
+                bottom_.store(b + 1, std::memory_order_relaxed);
+            }
+            return task;
+        }
+
+        Task* steal() {
+            int64_t t = top_.load(std::memory_order_acquire);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int64_t b = bottom_.load(std::memory_order_acquire);
+            if (t >= b) {
+                return nullptr;
+            }
+            Task* task = array_.load(std::memory_order_acquire)->get(t);
+            if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                return nullptr;
+            }
+            return task;
+        }
+    };
+
+    struct Worker {
+        ThreadPool& pool;
+        size_t index;
+        Deque deque;
+        std::thread thread;
+        uint64_t victim_state;
+
+        Worker(ThreadPool& pool, size_t index) : pool(pool), index(index), victim_state(index * 0x9E3779B97F4A7C15ull + 1) {
+        }
+    };
+
+    static constexpr int kSpinRounds = 64;
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::mutex inject_mutex_;
+    std::deque<Task*> injected_;
+    std::atomic<size_t> injected_count_{ 0 };
+    std::atomic<uint32_t> sleeping_{ 0 };
+    std::atomic<uint32_t> wake_{ 0 };
+    std::atomic<bool> stopping_{ false };
+    static inline thread_local Worker* current_ = nullptr;
+
+    void submit(Task* task) {
+        if (current_ && &current_->pool == this) {
+            current_->deque.push(task);
+        }
+        else {
+            std::lock_guard lock(inject_mutex_);
+            injected_.push_back(task);
+            injected_count_.fetch_add(1, std::memory_order_relaxed);
+        }
+        // Pairs with the fence in park(): either this sees the parked worker,
+        // or that worker's final scan sees the task.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (sleeping_.load(std::memory_order_relaxed) > 0) {
+            wake_.fetch_add(1, std::memory_order_relaxed);
+            wake_.notify_one();
+        }
+    }
+
+    Task* takeInjected() {
+        if (injected_count_.load(std::memory_order_relaxed) == 0) {
+            return nullptr;
+        }
+        std::lock_guard lock(inject_mutex_);
+        if (injected_.empty()) {
+            return nullptr;
+        }
+        Task* task = injected_.front();
+        injected_.pop_front();
+        injected_count_.fetch_sub(1, std::memory_order_relaxed);
+        return task;
+    }
+
+    // Own deque first, then the injection queue, then the other workers from
+    // a random starting victim.
+    Task* findTask(Worker* self) {
+        if (self) {
+            if (Task* task = self->deque.pop()) {
+                return task;
+            }
+        }
+        if (Task* task = takeInjected()) {
+            return task;
+        }
+        size_t count = workers_.size();
+        size_t start = 0;
+        if (self) {
+            self->victim_state ^= self->victim_state << 13;
+            self->victim_state ^= self->victim_state >> 7;
+            self->victim_state ^= self->victim_state << 17;
+            start = static_cast<size_t>(self->victim_state % count);
+        }
+        for (size_t i = 0; i < count; ++i) {
+            Worker& victim = *workers_[(start + i) % count];
+            if (&victim != self) {
+                if (Task* task = victim.deque.steal()) {
+                    return task;
+                }
+            }
+        }
+        return nullptr;
+    }
+
+    void execute(Task* task);
+
+    // Runs one queued task on the calling worker, if there is one. Threads
+    // outside the pool never help: the task they picked could be unrelated,
+    // and it could block or nest without bound on their stack.
+    bool runOne() {
+        if (!current_ || &current_->pool != this) {
+            return false;
+        }
+        Task* task = findTask(current_);
+        if (!task) {
+            return false;
+        }
+        execute(task);
+        return true;
+    }
+
+    // Spins briefly, then parks until a submitter bumps wake_. Returns the
+    // task found by the last scan, or null when the pool is stopping.
+    Task* park(Worker& self) {
+        for (int round = 0; round < kSpinRounds; ++round) {
+            if (Task* task = findTask(&self)) {
+                return task;
+            }
+            std::this_thread::yield();
+        }
+        while (true) {
+            sleeping_.fetch_add(1, std::memory_order_seq_cst);
+            uint32_t epoch = wake_.load(std::memory_order_seq_cst);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (Task* task = findTask(&self)) {
+                sleeping_.fetch_sub(1, std::memory_order_relaxed);
+                return task;
+            }
+            if (stopping_.load(std::memory_order_seq_cst)) {
+                sleeping_.fetch_sub(1, std::memory_order_relaxed);
+                return nullptr;
+            }
+            wake_.wait(epoch, std::memory_order_seq_cst);
+            sleeping_.fetch_sub(1, std::memory_order_relaxed);
+            if (Task* task = findTask(&self)) {
+                return task;
+            }
+        }
+    }
+
+    void workerLoop(Worker& self) {
+        current_ = &self;
+        while (true) {
+            Task* task = findTask(&self);
+            if (!task) {
+                task = park(self);
+                if (!task) {
+                    return;
+                }
+            }
+            execute(task);
+        }
+    }
+};
+
+// A set of tasks that can be waited for together. run() may be called from
+// any thread, including from inside the group's own tasks.
+class TaskGroup {
+public:
+    explicit TaskGroup(ThreadPool& pool = ThreadPool::shared()) : pool_(pool) {
+    }
+    TaskGroup(const TaskGroup&) = delete;
+    TaskGroup& operator=(const TaskGroup&) = delete;
+    ~TaskGroup() {
+        join();
+    }
+
+    template <typename Fn>
+    void run(Fn&& fn) {
+        struct Job : ThreadPool::Task {
+            std::decay_t<Fn> fn;
+            explicit Job(Fn&& fn) : fn(std::forward<Fn>(fn)) {
+            }
+            void run() override {
+                fn();
+            }
+        };
+        auto* job = new Job(std::forward<Fn>(fn));
+        job->group = this;
+        pending_.fetch_add(1, std::memory_order_relaxed);
+        pool_.submit(job);
+    }
+
+    // Blocks until this group's tasks are done, helping with queued tasks when
+    // called on a worker, then rethrows the first exception one of them threw.
+    void wait() {
+        join();
+        std::lock_guard lock(error_mutex_);
+        if (error_) {
+            std::exception_ptr error = std::exchange(error_, nullptr);
+            std::rethrow_exception(error);
+        }
+    }
+
+private:
+    friend class ThreadPool;
+
+    ThreadPool& pool_;
+    std::atomic<uint32_t> pending_{ 0 };
+    std::mutex error_mutex_;
+    std::exception_ptr error_;
+
+    void join() {
+        for (uint32_t pending = pending_.load(std::memory_order_acquire); pending != 0;
+            pending = pending_.load(std::memory_order_acquire)) {
+            if (!pool_.runOne()) {
+                pending_.wait(pending, std::memory_order_acquire);
+            }
+        }
+    }
+
+    void fail(std::exception_ptr error) {
+        std::lock_guard lock(error_mutex_);
+        if (!error_) {
+            error_ = error;
+        }
+    }
+
+    void finish() {
+        if (pending_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            pending_.notify_all();
+        }
+    }
+};
+
+inline void ThreadPool::execute(Task* task) {
+    TaskGroup* group = task->group;
+    try {
+        task->run();
+    }
+    catch (...) {
+        group->fail(std::current_exception());
+    }
+    delete task;
+    group->finish();
+}